@@ -17,12 +17,13 @@ LoadFile::LoadFile() {
 bool LoadFile::handleRequest(const HttpRequest& req, HttpResponse* resp) {
     const std::string& p = req.path();
     if (p == "/cloud" && req.method() == HttpRequest::kGet) {
-        std::string content;
-        if (FileUtil::readFile("www/cloud.html", content)) {
+        size_t size = 0;
+        int fd = FileUtil::openFile("www/cloud.html", &size);
+        if (fd >= 0) {
             resp->setStatusCode(HttpResponse::k200Ok);
             resp->setStatusMessage("OK");
             resp->setContentType("text/html");
-            resp->setBody(content);
+            resp->setBodyFile(fd, size);
         } else {
             resp->setStatusCode(HttpResponse::k404NotFound);
             resp->setStatusMessage("Not Found");
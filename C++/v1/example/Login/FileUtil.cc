@@ -2,6 +2,8 @@
 #include <fstream>
 #include <sstream>
 #include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 bool FileUtil::readFile(const std::string& filePath, std::string& content) {
     std::ifstream file(filePath, std::ios::binary);
@@ -28,4 +30,19 @@ size_t FileUtil::getFileSize(const std::string& filePath) {
     }
     return 0;
 }
-    
\ No newline at end of file
+    
+
+int FileUtil::openFile(const std::string& filePath, size_t* size) {
+    int fd = ::open(filePath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct stat buffer;
+    if (::fstat(fd, &buffer) != 0 || !S_ISREG(buffer.st_mode)) {
+        ::close(fd);
+        return -1;
+    }
+    *size = buffer.st_size;
+    return fd;
+}
@@ -13,6 +13,10 @@ public:
     
     // 获取文件大小
     static size_t getFileSize(const std::string& filePath);
+
+    // 以只读方式打开文件并返回 fd 和大小，失败返回 -1
+    // 配合 HttpResponse::setBodyFile 使用，文件内容不再读入内存
+    static int openFile(const std::string& filePath, size_t* size);
 };
 
 #endif // FILE_UTIL_H
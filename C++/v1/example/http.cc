@@ -97,13 +97,14 @@ void onRequest(const HttpRequest& req, HttpResponse* resp) {
     }
     
     else {
-        // 尝试读取请求的HTML文件
-        std::string content;
-        if (FileUtil::readFile("www" + req.path() + ".html", content)) {
+        // 尝试发送请求的HTML文件（sendfile，不读入内存）
+        size_t size = 0;
+        int fd = FileUtil::openFile("www" + req.path() + ".html", &size);
+        if (fd >= 0) {
             resp->setStatusCode(HttpResponse::k200Ok);
             resp->setStatusMessage("OK");
             resp->setContentType("text/html");
-            resp->setBody(content);
+            resp->setBodyFile(fd, size);
         } else {
             resp->setStatusCode(HttpResponse::k404NotFound);
             resp->setStatusMessage("Not Found");
@@ -0,0 +1,173 @@
+#include "CpuAffinity.h"
+#include "Logging.h"
+
+#include <sched.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace
+{
+    // 读取 sysfs 中 "0-3,8,10-11" 格式的 CPU 列表
+    std::vector<int> readCpuList(const char *path)
+    {
+        std::vector<int> cpus;
+        FILE *fp = ::fopen(path, "r");
+        if (fp == nullptr)
+        {
+            return cpus;
+        }
+        char buf[4096] = {0};
+        if (::fgets(buf, sizeof(buf), fp) != nullptr)
+        {
+            char *p = buf;
+            while (*p != '\0' && *p != '\n')
+            {
+                char *end = nullptr;
+                long first = ::strtol(p, &end, 10);
+                if (end == p)
+                {
+                    break;
+                }
+                long last = first;
+                p = end;
+                if (*p == '-')
+                {
+                    last = ::strtol(p + 1, &end, 10);
+                    p = end;
+                }
+                for (long cpu = first; cpu <= last; ++cpu)
+                {
+                    cpus.push_back(static_cast<int>(cpu));
+                }
+                if (*p == ',')
+                {
+                    ++p;
+                }
+            }
+        }
+        ::fclose(fp);
+        return cpus;
+    }
+
+    // 进程当前允许运行的 CPU
+    std::vector<int> allowedCpus()
+    {
+        std::vector<int> cpus;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (::sched_getaffinity(0, sizeof(set), &set) == 0)
+        {
+            for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+            {
+                if (CPU_ISSET(cpu, &set))
+                {
+                    cpus.push_back(cpu);
+                }
+            }
+        }
+        return cpus;
+    }
+
+    bool contains(const std::vector<int> &cpus, int cpu)
+    {
+        for (int c : cpus)
+        {
+            if (c == cpu)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+}
+
+CpuAffinity::CpuAffinity(Policy policy, const std::vector<int> &cpus)
+    : policy_(policy)
+{
+    std::vector<int> allowed = allowedCpus();
+    for (int cpu : cpus)
+    {
+        if (contains(allowed, cpu) && !contains(cpus_, cpu))
+        {
+            cpus_.push_back(cpu);
+        }
+    }
+    if (cpus_.empty())
+    {
+        LOG_WARN << "CpuAffinity: no usable cpu for policy " << static_cast<int>(policy) << ", threads stay unbound";
+    }
+}
+
+CpuAffinity CpuAffinity::cpuList(const std::vector<int> &cpus)
+{
+    return CpuAffinity(kCpuList, cpus);
+}
+
+CpuAffinity CpuAffinity::physicalCores()
+{
+    // 同一物理核的逻辑 CPU 里只保留编号最小的那个
+    std::vector<int> cpus;
+    for (int cpu : allowedCpus())
+    {
+        char path[128];
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", cpu);
+        std::vector<int> siblings = readCpuList(path);
+        if (siblings.empty() || siblings.front() == cpu)
+        {
+            cpus.push_back(cpu);
+        }
+    }
+    return CpuAffinity(kPhysicalCore, cpus);
+}
+
+CpuAffinity CpuAffinity::numaNode(int node)
+{
+    char path[128];
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+    return CpuAffinity(kNumaNode, readCpuList(path));
+}
+
+bool CpuAffinity::bindCurrentThread(int cpu)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int err = ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set);
+    if (err != 0)
+    {
+        LOG_WARN << "pthread_setaffinity_np cpu " << cpu << " failed: " << err;
+        return false;
+    }
+    return true;
+}
+
+int CpuAffinity::currentCpu()
+{
+    return ::sched_getcpu();
+}
+
+int CpuAffinity::nodeOfCpu(int cpu)
+{
+    // /sys/devices/system/cpu/cpuN/ 下有一个 nodeX 的链接
+    char path[128];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+    DIR *dir = ::opendir(path);
+    if (dir == nullptr)
+    {
+        return -1;
+    }
+    int node = -1;
+    while (struct dirent *entry = ::readdir(dir))
+    {
+        if (::strncmp(entry->d_name, "node", 4) == 0 && entry->d_name[4] >= '0' && entry->d_name[4] <= '9')
+        {
+            node = ::atoi(entry->d_name + 4);
+            break;
+        }
+    }
+    ::closedir(dir);
+    return node;
+}
@@ -0,0 +1,59 @@
+#ifndef CPU_AFFINITY_H
+#define CPU_AFFINITY_H
+
+#include <stddef.h>
+#include <vector>
+
+/**
+ * 线程的 CPU 绑定策略，用于 EventLoopThreadPool 和 ThreadPool
+ *
+ * 1. kCpuList：按给定的 CPU 列表依次绑定
+ * 2. kPhysicalCore：每个物理核只取一个逻辑 CPU，避免两个 loop 挤在同一核的超线程上
+ * 3. kNumaNode：只使用某个 NUMA 节点上的 CPU
+ *
+ * 候选 CPU 都会和进程当前允许的 CPU（taskset / cgroup）取交集，超出候选个数的线程循环复用
+ * 线程在创建 EventLoop 等对象之前完成绑定，按 Linux 默认的首次访问分配策略，
+ * 这些内存就会落在该 CPU 所在的 NUMA 节点上
+ */
+class CpuAffinity
+{
+public:
+    enum Policy
+    {
+        kNone,
+        kCpuList,
+        kPhysicalCore,
+        kNumaNode,
+    };
+
+    CpuAffinity() : policy_(kNone) {}
+
+    static CpuAffinity cpuList(const std::vector<int> &cpus);
+    static CpuAffinity physicalCores();
+    static CpuAffinity numaNode(int node);
+
+    Policy policy() const { return policy_; }
+    bool enabled() const { return policy_ != kNone && !cpus_.empty(); }
+    const std::vector<int>& cpus() const { return cpus_; }
+
+    // 第 index 个线程应绑定的 CPU，-1 表示不绑定
+    int cpuFor(int index) const
+    {
+        return enabled() ? cpus_[static_cast<size_t>(index) % cpus_.size()] : -1;
+    }
+
+    // 把调用线程绑定到 cpu 上，失败时打印警告并返回 false
+    static bool bindCurrentThread(int cpu);
+    // 调用线程当前运行的 CPU
+    static int currentCpu();
+    // cpu 所在的 NUMA 节点，无法确定时返回 -1
+    static int nodeOfCpu(int cpu);
+
+private:
+    CpuAffinity(Policy policy, const std::vector<int> &cpus);
+
+    Policy policy_;
+    std::vector<int> cpus_; // 候选 CPU，已经和进程允许的 CPU 取过交集
+};
+
+#endif // CPU_AFFINITY_H
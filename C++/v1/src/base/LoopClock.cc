@@ -0,0 +1,64 @@
+#include "LoopClock.h"
+
+#include <time.h>
+#include <atomic>
+
+namespace LoopClock
+{
+    __thread int64_t t_monotonicUs = 0;
+    __thread int64_t t_wallUs = 0;
+
+    namespace
+    {
+        __thread int64_t t_wallOffsetUs = 0;    // 墙上时间 - 单调时间
+        __thread int64_t t_calibratedAt = 0;    // 上一次校准偏移时的单调时间
+
+        // 偏移的校准间隔，系统时间被修改后最多这么久反映到缓存的墙上时间
+        const int64_t kCalibrateIntervalUs = Timestamp::kMicroSecondsPerSecond;
+
+        std::atomic<clockid_t> g_clockId(CLOCK_MONOTONIC);
+    }
+
+    namespace
+    {
+        int64_t readClock(clockid_t clockId)
+        {
+            struct timespec ts;
+            ::clock_gettime(clockId, &ts);
+            return static_cast<int64_t>(ts.tv_sec) * Timestamp::kMicroSecondsPerSecond + ts.tv_nsec / 1000;
+        }
+    }
+
+    int64_t monotonicMicroSeconds()
+    {
+        return readClock(g_clockId.load(std::memory_order_relaxed));
+    }
+
+    int64_t preciseMonotonicMicroSeconds()
+    {
+        return readClock(CLOCK_MONOTONIC);
+    }
+
+    Timestamp refresh()
+    {
+        int64_t mono = monotonicMicroSeconds();
+        if (t_calibratedAt == 0 || mono - t_calibratedAt >= kCalibrateIntervalUs)
+        {
+            t_wallOffsetUs = Timestamp::now().microSecondsSinceEpoch() - mono;
+            t_calibratedAt = mono;
+        }
+        t_monotonicUs = mono;
+        t_wallUs = mono + t_wallOffsetUs;
+        return Timestamp(t_wallUs);
+    }
+
+    void setCoarse(bool on)
+    {
+        g_clockId.store(on ? CLOCK_MONOTONIC_COARSE : CLOCK_MONOTONIC, std::memory_order_relaxed);
+    }
+
+    bool coarse()
+    {
+        return g_clockId.load(std::memory_order_relaxed) == CLOCK_MONOTONIC_COARSE;
+    }
+}
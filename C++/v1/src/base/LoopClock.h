@@ -0,0 +1,52 @@
+#ifndef LOOP_CLOCK_H
+#define LOOP_CLOCK_H
+
+#include <stdint.h>
+
+#include "Timestamp.h"
+
+/**
+ * 每个 loop 线程缓存的时钟，EventLoop 每次 poll 返回时刷新一次
+ *
+ * 1. 只读一次单调时钟（vDSO，不陷入内核），墙上时间由单调时钟加偏移得到，
+ *    偏移每秒用 gettimeofday 校准一次，同一轮里的 Logger、TimerQueue、HttpRequest 共用这次读数
+ * 2. setCoarse(true) 改用 CLOCK_MONOTONIC_COARSE，更便宜但精度只有一个 jiffy（通常 1~4ms），
+ *    只影响缓存给 Logger、HttpRequest 等的读数；定时器总是用 preciseMonotonicMicroSeconds，
+ *    否则 CLOCK_MONOTONIC 的 timerfd 触发时粗粒度时钟还没走到到期刻度，loop 会空转到它追上
+ * 3. 单调时钟不受修改系统时间影响，定时器都按它计算
+ *
+ * 非 loop 线程（从未刷新过）读取时直接读时钟
+ */
+namespace LoopClock
+{
+    extern __thread int64_t t_monotonicUs;  // 最近一次刷新的单调时间，0 表示本线程没有刷新过
+    extern __thread int64_t t_wallUs;       // 最近一次刷新的墙上时间
+
+    // 直接读单调时钟（微秒），setCoarse(true) 时是 CLOCK_MONOTONIC_COARSE
+    int64_t monotonicMicroSeconds();
+    // 直接读 CLOCK_MONOTONIC（微秒），不受 setCoarse 影响
+    int64_t preciseMonotonicMicroSeconds();
+
+    // 刷新本线程的缓存，返回刷新后的墙上时间，由 Poller 在 poll 返回时调用
+    Timestamp refresh();
+
+    // 全局切换是否使用 CLOCK_MONOTONIC_COARSE
+    void setCoarse(bool on);
+    bool coarse();
+
+    inline bool cached() { return t_monotonicUs != 0; }
+
+    // 缓存的单调时间（微秒）
+    inline int64_t monotonic()
+    {
+        return t_monotonicUs != 0 ? t_monotonicUs : monotonicMicroSeconds();
+    }
+
+    // 缓存的墙上时间
+    inline Timestamp now()
+    {
+        return t_monotonicUs != 0 ? Timestamp(t_wallUs) : Timestamp::now();
+    }
+}
+
+#endif // LOOP_CLOCK_H
@@ -0,0 +1,179 @@
+#ifndef MPSC_QUEUE_H
+#define MPSC_QUEUE_H
+
+#include <stddef.h>
+#include <atomic>
+#include <utility>
+
+#include "noncopyable.h"
+
+/**
+ * 无锁多生产者单消费者队列（Vyukov 链表队列）
+ * 任意线程都可以 push，只有一个线程（EventLoop 所在线程）可以 pop / consume
+ *
+ * push 只有一次 exchange 和一次 store，生产者之间不会互相等待
+ * 生产者在 exchange 和 store 之间被挂起时，消费者会暂时看不到之后的元素，
+ * 调用方需要在 push 完成后再唤醒消费者（见 EventLoop::queueInLoop）
+ *
+ * 节点复用，稳定运行时 push / pop 不做堆分配：
+ * 1. 消费者把用完的节点压入本队列的空闲栈（只有消费者压栈，CAS 不会有 ABA 问题）
+ * 2. 生产者本线程没有空闲节点时用一次 exchange 取走整个空闲栈，放进本线程的节点缓存，
+ *    之后的 push 直接从缓存取，不再碰共享变量；整栈取走而不是逐个弹出，同样没有 ABA 问题
+ * 3. 节点和队列无关，同一元素类型的队列共用线程缓存；线程退出时释放它缓存的节点，
+ *    空闲栈最多保留 kMaxFreeNodes 个，多出的直接释放
+ */
+template <typename T>
+class MpscQueue : noncopyable
+{
+public:
+    static const size_t kMaxFreeNodes = 1024;
+
+    MpscQueue()
+        : head_(new Node)
+        , tail_(head_.load(std::memory_order_relaxed))
+        , free_(nullptr)
+        , freeCount_(0)
+    {
+    }
+
+    ~MpscQueue()
+    {
+        T value;
+        while (pop(&value))
+        {
+        }
+        delete tail_;
+        // 此时已经没有生产者
+        Node *node = free_.load(std::memory_order_acquire);
+        while (node != nullptr)
+        {
+            Node *next = node->next.load(std::memory_order_relaxed);
+            delete node;
+            node = next;
+        }
+    }
+
+    // 任意线程调用
+    void push(T value)
+    {
+        Node *node = allocNode();
+        node->value = std::move(value);
+        Node *prev = head_.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    // 只能在消费者线程调用，队列为空时返回 false
+    bool pop(T *value)
+    {
+        Node *tail = tail_;
+        Node *next = tail->next.load(std::memory_order_acquire);
+        if (next == nullptr)
+        {
+            return false;
+        }
+        *value = std::move(next->value);
+        next->value = T();  // next 成为新的哨兵节点，尽早释放元素持有的资源
+        tail_ = next;
+        freeNode(tail);
+        return true;
+    }
+
+    /**
+     * 只能在消费者线程调用，依次处理调用时已经入队的元素，返回处理个数
+     * 处理过程中新入队的元素留给下一次，避免回调不断投递新任务时消费者出不来
+     */
+    template <typename F>
+    size_t consume(F &&func)
+    {
+        Node *last = head_.load(std::memory_order_acquire);
+        size_t count = 0;
+        T value;
+        while (tail_ != last && pop(&value))
+        {
+            func(value);
+            ++count;
+        }
+        return count;
+    }
+
+    // 只在消费者线程上有意义
+    bool empty() const
+    {
+        return tail_->next.load(std::memory_order_acquire) == nullptr;
+    }
+
+private:
+    struct Node
+    {
+        Node() : next(nullptr) {}
+
+        std::atomic<Node*> next;    // 在队列中指向下一个元素，空闲时指向下一个空闲节点
+        T value;
+    };
+
+    // 本线程缓存的空闲节点，只在本线程访问
+    struct NodeCache
+    {
+        Node *head = nullptr;
+
+        ~NodeCache()
+        {
+            while (head != nullptr)
+            {
+                Node *next = head->next.load(std::memory_order_relaxed);
+                delete head;
+                head = next;
+            }
+        }
+    };
+
+    static NodeCache& localCache()
+    {
+        static thread_local NodeCache cache;
+        return cache;
+    }
+
+    // 任意线程调用：先用本线程缓存，没有时取走消费者归还的全部节点，都没有才分配
+    Node* allocNode()
+    {
+        NodeCache &cache = localCache();
+        Node *node = cache.head;
+        if (node == nullptr)
+        {
+            node = free_.exchange(nullptr, std::memory_order_acquire);
+            if (node == nullptr)
+            {
+                return new Node;
+            }
+        }
+        cache.head = node->next.load(std::memory_order_relaxed);
+        node->next.store(nullptr, std::memory_order_relaxed);
+        return node;
+    }
+
+    // 只在消费者线程调用，节点的元素已经清空
+    void freeNode(Node *node)
+    {
+        Node *head = free_.load(std::memory_order_relaxed);
+        // 空闲栈只会被生产者整个取走，看到空栈说明之前归还的都已经被取走
+        if (head != nullptr && freeCount_ >= kMaxFreeNodes)
+        {
+            delete node;
+            return;
+        }
+        do
+        {
+            node->next.store(head, std::memory_order_relaxed);
+        } while (!free_.compare_exchange_weak(head, node,
+                                              std::memory_order_release,
+                                              std::memory_order_relaxed));
+        freeCount_ = head == nullptr ? 1 : freeCount_ + 1;
+    }
+
+    std::atomic<Node*> head_;   // 生产者端，最后入队的节点
+    Node *tail_;                // 消费者端，哨兵节点
+    std::atomic<Node*> free_;   // 消费者归还的空闲节点栈
+    size_t freeCount_;          // 空闲栈中的节点数，只由消费者维护
+};
+
+#endif // MPSC_QUEUE_H
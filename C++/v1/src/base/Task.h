@@ -0,0 +1,172 @@
+#ifndef TASK_H
+#define TASK_H
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/**
+ * 只能移动的 void() 可调用对象，用来代替 std::function<void()> 投递任务
+ *
+ * 1. 不超过 kInlineSize 字节的可调用对象直接放在对象内部，不做堆分配
+ *    std::bind(&TcpConnection::xxx, shared_from_this(), std::string) 这类常见绑定都放得下
+ * 2. 只能移动，任务在 queueInLoop / TimerQueue / ThreadPool 之间转手时不会复制，
+ *    绑定的 shared_ptr 也就不会反复增减引用计数
+ * 3. 放不下或移动可能抛异常的可调用对象退回到堆上保存
+ */
+class Task
+{
+public:
+    static const size_t kInlineSize = 64;
+
+    Task() noexcept : ops_(nullptr) {}
+    Task(std::nullptr_t) noexcept : ops_(nullptr) {}
+
+    template <typename F,
+              typename Fn = typename std::decay<F>::type,
+              typename = typename std::enable_if<!std::is_same<Fn, Task>::value>::type,
+              typename = decltype(std::declval<Fn&>()())>
+    Task(F &&f)
+        : ops_(nullptr)
+    {
+        if (isNull(f))
+        {
+            return;
+        }
+        if constexpr (fitsInline<Fn>())
+        {
+            ::new (static_cast<void*>(&storage_)) Fn(std::forward<F>(f));
+            ops_ = &InlineOps<Fn>::ops;
+        }
+        else
+        {
+            *reinterpret_cast<Fn**>(&storage_) = new Fn(std::forward<F>(f));
+            ops_ = &HeapOps<Fn>::ops;
+        }
+    }
+
+    Task(Task &&other) noexcept
+        : ops_(other.ops_)
+    {
+        if (ops_)
+        {
+            ops_->move(&other.storage_, &storage_);
+            other.ops_ = nullptr;
+        }
+    }
+
+    Task &operator=(Task &&other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            if (other.ops_)
+            {
+                other.ops_->move(&other.storage_, &storage_);
+                ops_ = other.ops_;
+                other.ops_ = nullptr;
+            }
+        }
+        return *this;
+    }
+
+    Task &operator=(std::nullptr_t) noexcept
+    {
+        reset();
+        return *this;
+    }
+
+    Task(const Task&) = delete;
+    Task &operator=(const Task&) = delete;
+
+    ~Task() { reset(); }
+
+    // 与 std::function 一致，const 对象也可以调用
+    void operator()() const
+    {
+        if (!ops_)
+        {
+            throw std::bad_function_call();
+        }
+        ops_->invoke(&storage_);
+    }
+
+    explicit operator bool() const noexcept { return ops_ != nullptr; }
+
+private:
+    using Storage = typename std::aligned_storage<kInlineSize, alignof(std::max_align_t)>::type;
+
+    // 按类型生成的“虚表”，比虚函数少一次间接寻址也不需要对象里的 vptr
+    struct Ops
+    {
+        void (*invoke)(void *storage);
+        void (*move)(void *from, void *to) noexcept;
+        void (*destroy)(void *storage) noexcept;
+    };
+
+    template <typename Fn>
+    static constexpr bool fitsInline()
+    {
+        return sizeof(Fn) <= kInlineSize
+            && alignof(std::max_align_t) % alignof(Fn) == 0
+            && std::is_nothrow_move_constructible<Fn>::value;
+    }
+
+    template <typename Fn>
+    struct InlineOps
+    {
+        static void invoke(void *storage) { (*static_cast<Fn*>(storage))(); }
+        static void move(void *from, void *to) noexcept
+        {
+            Fn *src = static_cast<Fn*>(from);
+            ::new (to) Fn(std::move(*src));
+            src->~Fn();
+        }
+        static void destroy(void *storage) noexcept { static_cast<Fn*>(storage)->~Fn(); }
+        static const Ops ops;
+    };
+
+    template <typename Fn>
+    struct HeapOps
+    {
+        static void invoke(void *storage) { (**static_cast<Fn**>(storage))(); }
+        static void move(void *from, void *to) noexcept
+        {
+            *static_cast<Fn**>(to) = *static_cast<Fn**>(from);
+        }
+        static void destroy(void *storage) noexcept { delete *static_cast<Fn**>(storage); }
+        static const Ops ops;
+    };
+
+    // 空的函数指针 / std::function 转换成空任务，行为与 std::function 相同
+    template <typename F>
+    static bool isNull(const F&) { return false; }
+    template <typename R, typename... Args>
+    static bool isNull(R (*const &f)(Args...)) { return f == nullptr; }
+    template <typename R, typename... Args>
+    static bool isNull(const std::function<R(Args...)> &f) { return !f; }
+
+    void reset() noexcept
+    {
+        if (ops_)
+        {
+            ops_->destroy(&storage_);
+            ops_ = nullptr;
+        }
+    }
+
+    mutable Storage storage_;
+    const Ops *ops_;
+};
+
+template <typename Fn>
+const Task::Ops Task::InlineOps<Fn>::ops = {
+    &Task::InlineOps<Fn>::invoke, &Task::InlineOps<Fn>::move, &Task::InlineOps<Fn>::destroy};
+
+template <typename Fn>
+const Task::Ops Task::HeapOps<Fn>::ops = {
+    &Task::HeapOps<Fn>::invoke, &Task::HeapOps<Fn>::move, &Task::HeapOps<Fn>::destroy};
+
+#endif // TASK_H
@@ -27,7 +27,7 @@ void ThreadPool::start()
         char id[32];
         snprintf(id, sizeof(id), "%d", i + 1);
         threads_.emplace_back(new Thread(
-            std::bind(&ThreadPool::runInThread, this), name_ + id));
+            std::bind(&ThreadPool::runInThread, this, affinity_.cpuFor(i)), name_ + id));
         threads_[i]->start();
     }
     // 不创建新线程
@@ -53,12 +53,17 @@ size_t ThreadPool::queueSize() const
 void ThreadPool::add(ThreadFunction ThreadFunction)
 {
     std::unique_lock<std::mutex> lock(mutex_);
-    queue_.push_back(ThreadFunction);
+    queue_.push_back(std::move(ThreadFunction));
     cond_.notify_one();
 }
 
-void ThreadPool::runInThread()
+void ThreadPool::runInThread(int cpu)
 {
+    // 先绑定再执行初始化回调，线程私有的数据在目标 CPU 的节点上分配
+    if (cpu >= 0)
+    {
+        CpuAffinity::bindCurrentThread(cpu);
+    }
     try 
     {
         if (threadInitCallback_)
@@ -79,12 +84,13 @@ void ThreadPool::runInThread()
                     }
                     cond_.wait(lock);
                 }
-                task = queue_.front();
+                task = std::move(queue_.front());
                 queue_.pop_front();
             }
-            if (task != nullptr) 
+            if (task) 
             {
                 task();
+                task = nullptr; // 及时释放任务持有的资源
             }
         }
     } 
@@ -4,6 +4,8 @@
 #include "noncopyable.h"
 #include "Thread.h"
 #include "Logging.h"
+#include "Task.h"
+#include "CpuAffinity.h"
 
 #include <deque>
 #include <vector>
@@ -13,13 +15,16 @@
 class ThreadPool : noncopyable
 {
 public:
-    using ThreadFunction = std::function<void()>;
+    using ThreadFunction = Task;    // 任务只移动不复制
+    using ThreadInitCallback = std::function<void()>;
 
     explicit ThreadPool(const std::string& name = std::string("ThreadPool"));
     ~ThreadPool();
 
-    void setThreadInitCallback(const ThreadFunction& cb) { threadInitCallback_ = cb; }
+    void setThreadInitCallback(const ThreadInitCallback& cb) { threadInitCallback_ = cb; }
     void setThreadSize(const int& num) { threadSize_ = num; }
+    // 工作线程的 CPU 绑定策略，第 i 个线程绑定 affinity.cpuFor(i)，需在 start 之前设置
+    void setCpuAffinity(const CpuAffinity& affinity) { affinity_ = affinity; }
     void start();
     void stop();
 
@@ -30,16 +35,17 @@ public:
 
 private:
     bool isFull() const;
-    void runInThread();
+    void runInThread(int cpu);
 
     mutable std::mutex mutex_;
     std::condition_variable cond_;
     std::string name_;
-    ThreadFunction threadInitCallback_;
+    ThreadInitCallback threadInitCallback_;
     std::vector<std::unique_ptr<Thread>> threads_;
     std::deque<ThreadFunction> queue_;
     bool running_;
     size_t threadSize_;
+    CpuAffinity affinity_;
 };
 
 # endif // THREAD_POOL_H
@@ -5,6 +5,16 @@
 #include <string.h>
 
 void HttpResponse::appendToBuffer(Buffer* output) const
+{
+    appendHeadersToBuffer(output);
+    // 文件响应体由 HttpServer 随后通过 sendfile 发送
+    if (!hasBodyFile())
+    {
+        output->append(body_); 
+    }
+}
+
+void HttpResponse::appendHeadersToBuffer(Buffer* output) const
 {
     // 响应行
     char buf[32];
@@ -20,7 +30,8 @@ void HttpResponse::appendToBuffer(Buffer* output) const
     }
     else
     {
-        snprintf(buf, sizeof(buf), "Content-Length: %zd\r\n", body_.size());
+        size_t contentLength = hasBodyFile() ? bodyFileLength_ : body_.size();
+        snprintf(buf, sizeof(buf), "Content-Length: %zd\r\n", contentLength);
         output->append(buf);
         output->append("Connection: Keep-Alive\r\n");
     }
@@ -33,5 +44,4 @@ void HttpResponse::appendToBuffer(Buffer* output) const
         output->append("\r\n");
     }
     output->append("\r\n");
-    output->append(body_); 
 }
\ No newline at end of file
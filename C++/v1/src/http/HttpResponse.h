@@ -4,9 +4,12 @@
 #include <unordered_map>
 #include <cstring>
 #include <string>
+#include <unistd.h>
+
+#include "noncopyable.h"
 
 class Buffer;
-class HttpResponse
+class HttpResponse : noncopyable
 {
 public:
     // 响应状态码
@@ -22,10 +25,20 @@ public:
 
     explicit HttpResponse(bool close)
       : statusCode_(kUnknown),
-        closeConnection_(close)
+        closeConnection_(close),
+        bodyFileFd_(-1),
+        bodyFileLength_(0)
     {
     }   
 
+    ~HttpResponse()
+    {
+        if (bodyFileFd_ >= 0)
+        {
+            ::close(bodyFileFd_);
+        }
+    }
+
     void setStatusCode(HttpStatusCode code)
     { statusCode_ = code; } 
 
@@ -47,7 +60,35 @@ public:
     void setBody(const std::string& body)
     { body_ = body; }   
 
+    const std::string& body() const
+    { return body_; }
+
+    // 以文件内容作为响应体，HttpServer 会用 sendfile 发送，不再读入内存
+    // fd 的所有权交给 HttpResponse
+    void setBodyFile(int fd, size_t length)
+    {
+        if (bodyFileFd_ >= 0)
+        {
+            ::close(bodyFileFd_);
+        }
+        bodyFileFd_ = fd;
+        bodyFileLength_ = length;
+    }
+
+    bool hasBodyFile() const { return bodyFileFd_ >= 0; }
+    size_t bodyFileLength() const { return bodyFileLength_; }
+
+    // 交出文件 fd 的所有权
+    int releaseBodyFile()
+    {
+        int fd = bodyFileFd_;
+        bodyFileFd_ = -1;
+        return fd;
+    }
+
     void appendToBuffer(Buffer* output) const;
+    // 只序列化响应行和响应头，响应体由调用者单独发送
+    void appendHeadersToBuffer(Buffer* output) const;
 
 private:
     std::unordered_map<std::string, std::string> headers_;
@@ -56,6 +97,8 @@ private:
     std::string statusMessage_;
     bool closeConnection_;
     std::string body_;
+    int bodyFileFd_;        // 文件响应体，-1 表示没有
+    size_t bodyFileLength_;
 };
 
 #endif // HTTP_HTTPRESPONSE_H
\ No newline at end of file
@@ -34,6 +34,14 @@ void HttpServer::start()
 {
     LOG_INFO << "HttpServer[" << server_.name().c_str() << "] starts listening on " << server_.ipPort().c_str();
     server_.start();
+    if (!metricsPath_.empty())
+    {
+        // IO 线程在 start 中才创建
+        for (EventLoop* loop : server_.ioLoops())
+        {
+            loop->setMetricsEnabled(true);
+        }
+    }
 }
 
 void HttpServer::onConnection(const TcpConnectionPtr& conn)
@@ -89,15 +97,48 @@ void HttpServer::onRequest(const TcpConnectionPtr& conn, const HttpRequest& req)
         (req.version() == HttpRequest::kHttp10 && connection != "Keep-Alive");
     // 响应信息
     HttpResponse response(close);
-    // httpCallback_ 由用户传入，怎么写响应体由用户决定
-    // 此处初始化了一些response的信息，比如响应码，回复OK
-    httpCallback_(req, &response);
+    if (!metricsPath_.empty() && req.path() == metricsPath_)
+    {
+        handleMetrics(&response);
+    }
+    else
+    {
+        // httpCallback_ 由用户传入，怎么写响应体由用户决定
+        // 此处初始化了一些response的信息，比如响应码，回复OK
+        httpCallback_(req, &response);
+    }
     Buffer buf;
-    response.appendToBuffer(&buf);
-    // TODO:需要重载 TcpConnection::send 使其可以接收一个缓冲区
-    conn->send(&buf);
+    response.appendHeadersToBuffer(&buf);
+    if (response.hasBodyFile())
+    {
+        conn->send(&buf);
+        // 响应体排在响应头之后，由内核直接从文件发送
+        conn->sendFile(response.releaseBodyFile(), 0, response.bodyFileLength());
+    }
+    else
+    {
+        // 响应头和响应体用一次 writev 发出，响应体不再拷贝进临时缓冲区
+        std::string_view pieces[2] = {
+            std::string_view(buf.peek(), buf.readableBytes()),
+            response.body()
+        };
+        conn->send(pieces, 2);
+    }
     if (response.closeConnection())
     {
         conn->shutdown();
     }
-}
\ No newline at end of file
+}
+
+void HttpServer::handleMetrics(HttpResponse* resp)
+{
+    // 各计数只由所属 IO 线程写，这里读取的是近似一致的快照
+    std::string body;
+    MetricsWriter writer(&body);
+    LoopMetrics::write(&writer, server_.ioLoops());
+    server_.writeMetrics(&writer);
+    resp->setStatusCode(HttpResponse::k200Ok);
+    resp->setStatusMessage("OK");
+    resp->setContentType("text/plain; version=0.0.4");
+    resp->setBody(body);
+}
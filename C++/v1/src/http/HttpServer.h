@@ -26,6 +26,15 @@ public:
         httpCallback_ = cb;
     }
     
+    /**
+     * 开启指标接口：GET path 返回 Prometheus 文本格式的各 IO 线程统计（见 LoopMetrics）
+     * 和本服务器的连接数、收发字节数，同时打开 IO 线程的统计。需在 start 之前设置
+     */
+    void enableMetrics(const std::string& path = "/metrics")
+    {
+        metricsPath_ = path;
+    }
+
     void start();
 
 private:
@@ -34,9 +43,11 @@ private:
                     Buffer *buf,
                     Timestamp receiveTime);
     void onRequest(const TcpConnectionPtr&, const HttpRequest&);
+    void handleMetrics(HttpResponse* resp);
 
     TcpServer server_;
     HttpCallback httpCallback_;
+    std::string metricsPath_;   // 为空表示不提供指标接口
 };
 
 #endif // HTTP_HTTPSERVER_H
\ No newline at end of file
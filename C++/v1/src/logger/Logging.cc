@@ -1,5 +1,6 @@
 #include "Logging.h"
 #include "CurrentThread.h"
+#include "LoopClock.h"
 
 namespace ThreadInfo
 {
@@ -30,6 +31,7 @@ Logger::LogLevel initLogLevel()
 }
 
 Logger::LogLevel g_logLevel = initLogLevel();
+bool g_useLoopClock = false;
 
 static void defaultOutput(const char* data, int len)
 {
@@ -45,7 +47,7 @@ Logger::OutputFunc g_output = defaultOutput;
 Logger::FlushFunc g_flush = defaultFlush;
 
 Logger::Impl::Impl(Logger::LogLevel level, int savedErrno, const char* file, int line)
-    : time_(Timestamp::now()),
+    : time_(g_useLoopClock ? LoopClock::now() : Timestamp::now()),
       stream_(),
       level_(level),
       line_(line),
@@ -65,21 +67,26 @@ Logger::Impl::Impl(Logger::LogLevel level, int savedErrno, const char* file, int
 // Timestamp::toString方法的思路，只不过这里需要输出到流
 void Logger::Impl::formatTime()
 {
-    Timestamp now = Timestamp::now();
-    time_t seconds = static_cast<time_t>(now.microSecondsSinceEpoch() / Timestamp::kMicroSecondsPerSecond);
-    int microseconds = static_cast<int>(now.microSecondsSinceEpoch() % Timestamp::kMicroSecondsPerSecond);
-
-    struct tm *tm_time = localtime(&seconds);
-    // 写入此线程存储的时间buf中
-    snprintf(ThreadInfo::t_time, sizeof(ThreadInfo::t_time), "%4d/%02d/%02d %02d:%02d:%02d",
-        tm_time->tm_year + 1900,
-        tm_time->tm_mon + 1,
-        tm_time->tm_mday,
-        tm_time->tm_hour,
-        tm_time->tm_min,
-        tm_time->tm_sec);
-    // 更新最后一次时间调用
-    ThreadInfo::t_lastSecond = seconds;
+    // 使用构造时取得的 time_，不再读一次时钟
+    time_t seconds = static_cast<time_t>(time_.microSecondsSinceEpoch() / Timestamp::kMicroSecondsPerSecond);
+    int microseconds = static_cast<int>(time_.microSecondsSinceEpoch() % Timestamp::kMicroSecondsPerSecond);
+
+    // 同一秒内的日期时间部分不变，只在秒数变化时重新格式化
+    if (seconds != ThreadInfo::t_lastSecond)
+    {
+        struct tm tm_time;
+        localtime_r(&seconds, &tm_time);
+        // 写入此线程存储的时间buf中
+        snprintf(ThreadInfo::t_time, sizeof(ThreadInfo::t_time), "%4d/%02d/%02d %02d:%02d:%02d",
+            tm_time.tm_year + 1900,
+            tm_time.tm_mon + 1,
+            tm_time.tm_mday,
+            tm_time.tm_hour,
+            tm_time.tm_min,
+            tm_time.tm_sec);
+        // 更新最后一次时间调用
+        ThreadInfo::t_lastSecond = seconds;
+    }
 
     // muduo使用Fmt格式化整数，这里我们直接写入buf
     char buf[32] = {0};
@@ -134,6 +141,11 @@ void Logger::setLogLevel(Logger::LogLevel level)
     g_logLevel = level;
 }
 
+void Logger::setUseLoopClock(bool on)
+{
+    g_useLoopClock = on;
+}
+
 void Logger::setOutput(OutputFunc out)
 {
     g_output = out;
@@ -60,6 +60,12 @@ public:
     static LogLevel logLevel();
     static void setLogLevel(LogLevel level);
 
+    /**
+     * 日志时间使用 loop 线程缓存的时钟（见 LoopClock），不再每条日志读一次时钟
+     * loop 线程里的时间是本轮 poll 返回的时刻，非 loop 线程不受影响
+     */
+    static void setUseLoopClock(bool on);
+
     // 输出函数和刷新缓冲区函数
     using OutputFunc = std::function<void(const char* msg, int len)>;
     using FlushFunc = std::function<void()>;
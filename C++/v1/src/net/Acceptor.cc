@@ -5,6 +5,8 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
 
 static int createNonblocking()
 {
@@ -21,7 +23,9 @@ Acceptor::Acceptor(EventLoop *loop, const InetAddress &ListenAddr, bool reusepor
     : loop_(loop),
     acceptSocket_(createNonblocking()),
     acceptChannel_(loop, acceptSocket_.fd()),
-    listenning_(false)
+    listenning_(false),
+    acceptBatch_(kDefaultAcceptBatch),
+    idleFd_(::open("/dev/null", O_RDONLY | O_CLOEXEC))
 {
     LOG_DEBUG << "Acceptor create nonblocking socket, [fd = " << acceptChannel_.fd() << "]";
     // LOG_DEBUG("%s:%s:%d Acceptor create nonblocking socket, fd = %d\n", __FILE__, __FUNCTION__, __LINE__, acceptChannel_.fd());
@@ -44,53 +48,92 @@ Acceptor::~Acceptor()
     acceptChannel_.disableAll();    
     // 调用EventLoop->removeChannel => Poller->removeChannel 把Poller的ChannelMap对应的部分删除
     acceptChannel_.remove();       
+    if (idleFd_ >= 0)
+    {
+        ::close(idleFd_);
+    }
+}
+
+void Acceptor::listenSocket()
+{
+    if (!listenning_)
+    {
+        // 表示正在监听
+        listenning_ = true;
+        acceptSocket_.listen();
+    }
 }
 
 void Acceptor::listen()
 {
-    // 表示正在监听
-    listenning_ = true;
-    acceptSocket_.listen();
+    listenSocket();
     // 将acceptChannel的读事件注册到poller
     acceptChannel_.enableReading();
 }
 
 // listenfd有事件发生了，就是有新用户连接了
+// 一次事件最多接受 acceptBatch_ 个连接，减少高连接速率下 poll 的次数
 void Acceptor::handleRead()
 {
-    // 使用了InetAddress类型定义对象，需要包含头文件
-    // 之前为了不加载头文件使用了前置声明
-    InetAddress peerAddr;
-    // 接受新连接
-    int connfd = acceptSocket_.accept(&peerAddr);
-    // 确实有新连接到来
-    if (connfd >= 0)
+    for (int i = 0; i < acceptBatch_; ++i)
     {
-        // TcpServer::NewConnectionCallback_
-        if (NewConnectionCallback_)
+        // 使用了InetAddress类型定义对象，需要包含头文件
+        // 之前为了不加载头文件使用了前置声明
+        InetAddress peerAddr;
+        // 接受新连接
+        int connfd = acceptSocket_.accept(&peerAddr);
+        // 确实有新连接到来
+        if (connfd >= 0)
         {
-            // 轮询找到subLoop 唤醒并分发当前的新客户端的Channel
-            NewConnectionCallback_(connfd, peerAddr); 
+            // TcpServer::NewConnectionCallback_
+            if (NewConnectionCallback_)
+            {
+                // 轮询找到subLoop 唤醒并分发当前的新客户端的Channel
+                NewConnectionCallback_(connfd, peerAddr); 
+            }
+            else
+            {
+                LOG_DEBUG << "no newConnectionCallback() function";
+                ::close(connfd);
+            }
+            continue;
         }
-        else
+
+        int savedErrno = errno;
+        if (savedErrno == EAGAIN || savedErrno == EWOULDBLOCK)
         {
-            LOG_DEBUG << "no newConnectionCallback() function";
-            // LOG_DEBUG("connfd < 0 accept failed");
-            ::close(connfd);
+            // 队列已经取空
+            break;
         }
-    }
-    else
-    {
-        LOG_ERROR << "accept() failed";
-        // LOG_ERROR("%s:%s:%d accept err:%d\n", __FILE__, __FUNCTION__, __LINE__, errno);
-
-        // 当前进程的fd已经用完了
-        // 可以调整单个服务器的fd上限
-        // 也可以分布式部署
-        if (errno == EMFILE)
+        else if (savedErrno == EMFILE || savedErrno == ENFILE)
         {
-            LOG_ERROR << "sockfd reached limit";
-            // LOG_ERROR("%s:%s:%d sockfd reached limit\n", __FILE__, __FUNCTION__, __LINE__);
+            /**
+             * 当前进程的fd已经用完了，不处理的话 listenfd 一直可读，loop 会空转
+             * 让出备用 fd 接受一个连接并立即关闭，对端能及时收到关闭而不是一直挂在队列里
+             * 根本的解决办法还是调整单个服务器的fd上限或者用 TcpServer::setMaxConnections 限流
+             */
+            LOG_ERROR << "sockfd reached limit, shedding connection";
+            shedConnection();
         }
+        else if (savedErrno != ECONNABORTED && savedErrno != EINTR && savedErrno != EPROTO)
+        {
+            // 对端在 accept 之前就断开等情况可以继续，其他错误留到下一次事件
+            break;
+        }
+    }
+}
+
+void Acceptor::shedConnection()
+{
+    if (idleFd_ < 0)
+    {
+        return;
     }
-}
\ No newline at end of file
+    ::close(idleFd_);
+    idleFd_ = ::accept(acceptSocket_.fd(), nullptr, nullptr);
+    if (idleFd_ >= 0)
+    {
+        ::close(idleFd_);
+    }
+    idleFd_ = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+}
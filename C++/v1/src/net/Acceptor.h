@@ -26,16 +26,33 @@ public:
     }
 
     bool listenning() const { return listenning_; }
+    // 每次可读事件最多 accept 的连接数，队列取空（EAGAIN）时提前结束
+    void setAcceptBatch(int n) { acceptBatch_ = n > 0 ? n : 1; }
+
+    // listen 并开始接受连接，只能在 loop 线程调用
     void listen();
+    /**
+     * 只调用 listen(2)，不注册读事件，可在任意线程调用
+     * 多个 SO_REUSEPORT 套接字按调用顺序加入同一个组，组内下标见 Socket::attachReusePortCpuSteering
+     */
+    void listenSocket();
+
+    Socket& socket() { return acceptSocket_; }
+
+    static const int kDefaultAcceptBatch = 16;
 
 private:
     void handleRead();
+    // fd 用完时用备用 fd 接受并立即关闭一个连接
+    void shedConnection();
 
     EventLoop *loop_; // Acceptor用的就是用户定义的BaseLoop
     Socket acceptSocket_;
     Channel acceptChannel_;
     NewConnectionCallback NewConnectionCallback_;
     bool listenning_; // 是否正在监听的标志
+    int acceptBatch_;
+    int idleFd_;      // 备用 fd（/dev/null），EMFILE 时让出来接受连接
 };
 
 #endif // ACCEPTOR_H
\ No newline at end of file
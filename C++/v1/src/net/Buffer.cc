@@ -17,8 +17,14 @@ const char Buffer::kCRLF[] = "\r\n";
  **/
 ssize_t Buffer::readFd(int fd, int *saveErrno)
 {
+    if (segmented())
+    {
+        return readFdSegmented(fd, saveErrno);
+    }
+
     // 栈额外空间，用于从套接字往出读时，当buffer_暂时不够用时暂存数据，待buffer_重新分配足够空间后，在把数据交换给buffer_。
-    char extrabuf[65536] = {0}; // 栈上内存空间 65536/1024 = 64KB
+    // 不做初始化：readv 只会写入、append 只拷贝实际读到的 n - writable 字节，清零 64KB 纯属浪费
+    char extrabuf[65536]; // 栈上内存空间 65536/1024 = 64KB
 
     /*
     struct iovec {
@@ -63,12 +69,127 @@ ssize_t Buffer::readFd(int fd, int *saveErrno)
 
 // inputBuffer_.readFd表示将对端数据读到inputBuffer_中，移动writerIndex_指针
 // outputBuffer_.writeFd表示将数据写入到outputBuffer_中，从readerIndex_开始，可以写readableBytes()个字节
-ssize_t Buffer::writeFd(int fd, int *saveErrno)
+ssize_t Buffer::writeFd(int fd, int *saveErrno, size_t maxBytes)
 {
-    ssize_t n = ::write(fd, peek(), readableBytes());
+    if (segmented())
+    {
+        return writeFdSegmented(fd, saveErrno, maxBytes);
+    }
+
+    ssize_t n = ::write(fd, peek(), std::min(readableBytes(), maxBytes));
     if (n < 0)
     {
         *saveErrno = errno;
     }
     return n;
-}
\ No newline at end of file
+}
+
+/**
+ * 分段模式下的读：readv 同时读入尾块剩余空间和一个备用块
+ * 备用块直接成为链表中的新分段，不需要栈上 extrabuf 中转，也不会再拷贝一次
+ */
+ssize_t Buffer::readFdSegmented(int fd, int *saveErrno)
+{
+    if (writableBytes() == 0)
+    {
+        appendSegment(blockSize_);
+    }
+
+    if (!spareBlock_)
+    {
+        spareBlock_ = std::make_shared<BufferBlock>(blockSize_);
+    }
+
+    struct iovec vec[2];
+    const size_t writable = writableBytes();
+    vec[0].iov_base = beginWrite();
+    vec[0].iov_len = writable;
+    vec[1].iov_base = spareBlock_->data();
+    vec[1].iov_len = spareBlock_->capacity();
+
+    const ssize_t n = ::readv(fd, vec, 2);
+    if (n < 0)
+    {
+        *saveErrno = errno;
+    }
+    else if (static_cast<size_t>(n) <= writable)
+    {
+        segments_.back().writeIndex += n;
+        segmentedBytes_ += n;
+    }
+    else
+    {
+        // 备用块也读入了数据，把它链接到尾部，下次再重新分配备用块
+        segments_.back().writeIndex += writable;
+        segments_.push_back(Segment{std::move(spareBlock_), 0, n - writable});
+        segmentedBytes_ += n;
+    }
+    return n;
+}
+
+const char* Buffer::findCRLFSegmented() const
+{
+    size_t offset = 0;      // 当前分段之前的可读字节数
+    bool pendingCR = false; // 上一个分段是否以 '\r' 结尾
+    for (size_t i = 0; i < segments_.size(); ++i)
+    {
+        const Segment &seg = segments_[i];
+        const char *start = seg.begin();
+        const char *end = seg.end();
+        if (start == end)
+        {
+            continue;
+        }
+        size_t found = SIZE_MAX;
+        if (pendingCR && *start == '\n')
+        {
+            // "\r\n" 跨越两个分段
+            found = offset - 1;
+        }
+        else
+        {
+            const char *crlf = std::search(start, end, kCRLF, kCRLF + 2);
+            if (crlf != end)
+            {
+                found = offset + (crlf - start);
+            }
+        }
+        if (found != SIZE_MAX)
+        {
+            // 调用方接着会用 peek()，先合并，返回的指针在之后的 peek() 中仍然有效
+            pullup();
+            return segments_.front().begin() + found;
+        }
+        pendingCR = end[-1] == '\r';
+        offset += seg.readableBytes();
+    }
+    return NULL;
+}
+
+// 分段模式下的写：一次 writev 发送所有待发送分段（最多 kMaxWriteIovecs 个）
+ssize_t Buffer::writeFdSegmented(int fd, int *saveErrno, size_t maxBytes)
+{
+    struct iovec vec[kMaxWriteIovecs];
+    int iovcnt = 0;
+    for (const Segment &seg : segments_)
+    {
+        if (iovcnt == kMaxWriteIovecs || maxBytes == 0)
+        {
+            break;
+        }
+        if (seg.readableBytes() > 0)
+        {
+            vec[iovcnt].iov_base = seg.begin();
+            vec[iovcnt].iov_len = std::min(seg.readableBytes(), maxBytes);
+            maxBytes -= vec[iovcnt].iov_len;
+            ++iovcnt;
+        }
+    }
+
+    ssize_t n = ::writev(fd, vec, iovcnt);
+    if (n < 0)
+    {
+        *saveErrno = errno;
+    }
+    return n;
+}
@@ -4,6 +4,67 @@
 #include <vector>
 #include <string>
 #include <algorithm>
+#include <memory>
+#include <string.h>
+#include <stdint.h>
+
+#include "noncopyable.h"
+
+/**
+ * 分段模式下使用的定长内存块
+ * 通过 shared_ptr 管理引用计数，BufferSlice 持有引用时内存块不会被复用或释放
+ */
+class BufferBlock : noncopyable
+{
+public:
+    explicit BufferBlock(size_t capacity)
+        : data_(new char[capacity]),   // 不做清零，避免无谓的 memset
+          capacity_(capacity)
+    {
+    }
+
+    char* data() { return data_.get(); }
+    const char* data() const { return data_.get(); }
+    size_t capacity() const { return capacity_; }
+
+private:
+    std::unique_ptr<char[]> data_;
+    const size_t capacity_;
+};
+
+using BufferBlockPtr = std::shared_ptr<BufferBlock>;
+
+/**
+ * 指向某个 BufferBlock 中一段数据的只读视图
+ * onMessage 中可以持有它而不必把数据拷贝成 std::string
+ */
+class BufferSlice
+{
+public:
+    BufferSlice()
+        : data_(nullptr),
+          len_(0)
+    {
+    }
+
+    BufferSlice(BufferBlockPtr block, const char *data, size_t len)
+        : block_(std::move(block)),
+          data_(data),
+          len_(len)
+    {
+    }
+
+    const char* data() const { return data_; }
+    size_t size() const { return len_; }
+    bool empty() const { return len_ == 0; }
+
+    std::string toString() const { return std::string(data_, len_); }
+
+private:
+    BufferBlockPtr block_;  // 保证数据在切片存活期间有效
+    const char *data_;
+    size_t len_;
+};
 
 /// +-------------------+------------------+------------------+
 /// | prependable bytes |  readable bytes  |  writable bytes  |
@@ -11,40 +72,93 @@
 /// +-------------------+------------------+------------------+
 /// |                   |                  |                  |
 /// 0      <=      readerIndex   <=   writerIndex    <=     size
+///
+/// 分段模式(kSegmented)下不再使用上面的连续内存，而是由若干定长 BufferBlock 串成链：
+/// | block0 [read, write) | block1 [read, write) | ... |
+/// 扩容只需链接新块，不会 realloc 或 memmove；writeFd 使用 writev 一次发送所有分段
 class Buffer
 {
 public:
+    enum Mode
+    {
+        kContiguous,    // 默认：单块连续内存
+        kSegmented      // 定长内存块链表
+    };
+
     // prependable 初始大小，readIndex 初始位置
     static const size_t kCheapPrepend = 8;
     // writeable 初始大小，writeIndex 初始位置  
     // 刚开始 readerIndex 和 writerIndex 处于同一位置
     static const size_t kInitialSize = 1024;    
+    // 分段模式下每个内存块的默认大小
+    static const size_t kBlockSize = 16 * 1024;
+    // writeFd 一次 writev 最多携带的分段数
+    static const int kMaxWriteIovecs = 64;
 
     explicit Buffer(size_t initialSize = kInitialSize)
         :   buffer_(kCheapPrepend + initialSize),
             readerIndex_(kCheapPrepend),
-            writerIndex_(kCheapPrepend)
+            writerIndex_(kCheapPrepend),
+            mode_(kContiguous),
+            blockSize_(kBlockSize),
+            segmentedBytes_(0)
         {}
+
+    explicit Buffer(Mode mode, size_t blockSize = kBlockSize)
+        :   buffer_(mode == kContiguous ? kCheapPrepend + kInitialSize : 0),
+            readerIndex_(kCheapPrepend),
+            writerIndex_(kCheapPrepend),
+            mode_(mode),
+            blockSize_(blockSize),
+            segmentedBytes_(0)
+        {}
+
+    Mode mode() const { return mode_; }
+    bool segmented() const { return mode_ == kSegmented; }
     
     /**
      * kCheapPrepend | reader | writer |
      * writerIndex_ - readerIndex_
      */
-    size_t readableBytes() const { return writerIndex_ - readerIndex_; }
+    size_t readableBytes() const
+    {
+        return segmented() ? segmentedBytes_ : writerIndex_ - readerIndex_;
+    }
     /**
      * kCheapPrepend | reader | writer |
      * buffer_.size() - writerIndex_
+     * 分段模式下为尾块剩余的连续空间
      */   
-    size_t writableBytes() const { return buffer_.size() - writerIndex_; }
+    size_t writableBytes() const
+    {
+        if (segmented())
+        {
+            return segments_.empty() ? 0 : segments_.back().writableBytes();
+        }
+        return buffer_.size() - writerIndex_;
+    }
     /**
      * kCheapPrepend | reader | writer |
      * wreaderIndex_
      */    
-    size_t prependableBytes() const { return readerIndex_; }
+    size_t prependableBytes() const
+    {
+        if (segmented())
+        {
+            return segments_.empty() ? 0 : segments_.front().readIndex;
+        }
+        return readerIndex_;
+    }
 
     // 返回缓冲区中可读数据的起始地址
+    // 分段模式下如果可读数据跨越多个内存块，会先把它们合并到一个块中
     const char* peek() const
     {
+        if (segmented())
+        {
+            pullup();
+            return segments_.empty() ? nullptr : segments_.front().begin();
+        }
         return begin() + readerIndex_;
     }
 
@@ -57,6 +171,11 @@ public:
     // 需要进行复位操作
     void retrieve(size_t len)
     {
+        if (segmented())
+        {
+            retrieveSegments(len);
+            return;
+        }
         // 应用只读取可读缓冲区数据的一部分(读取了len的长度)
         if (len < readableBytes())
         {
@@ -73,6 +192,11 @@ public:
     // 全部读完，则直接将可读缓冲区指针移动到写缓冲区指针那
     void retrieveAll()
     {
+        if (segmented())
+        {
+            retrieveAllSegments();
+            return;
+        }
         readerIndex_ = kCheapPrepend;
         writerIndex_ = kCheapPrepend;
     }
@@ -81,7 +205,8 @@ public:
     std::string GetBufferAllAsString()
     {
         size_t len = readableBytes();
-        std::string result(peek(), len);
+        std::string result(len, '\0');
+        copyOut(&result[0], len);
         return result;
     }
 
@@ -94,6 +219,15 @@ public:
 
     std::string retrieveAsString(size_t len)
     {
+        if (segmented())
+        {
+            // 直接从各分段拷贝，避免先 pullup 再拷贝的两次复制
+            len = std::min(len, readableBytes());
+            std::string result(len, '\0');
+            copyOut(&result[0], len);
+            retrieve(len);
+            return result;
+        }
         // peek()可读数据的起始地址
         std::string result(peek(), len);
         // 上面一句把缓冲区中可读取的数据读取出来，所以要将缓冲区复位
@@ -101,11 +235,43 @@ public:
         return result;
     }
 
+    /**
+     * 取出前 len 字节作为引用计数的切片
+     * 分段模式下若数据位于首个内存块内则零拷贝共享该块，否则拷贝一次到新块中
+     */
+    BufferSlice retrieveAsSlice(size_t len)
+    {
+        len = std::min(len, readableBytes());
+        if (segmented() && !segments_.empty() && segments_.front().readableBytes() >= len)
+        {
+            const Segment &head = segments_.front();
+            BufferSlice slice(head.block, head.begin(), len);
+            retrieve(len);
+            return slice;
+        }
+        BufferBlockPtr block = std::make_shared<BufferBlock>(len);
+        char *data = block->data();
+        copyOut(data, len);
+        retrieve(len);
+        return BufferSlice(std::move(block), data, len);
+    }
+
+    BufferSlice retrieveAllAsSlice()
+    {
+        return retrieveAsSlice(readableBytes());
+    }
+
     // buffer_.size() - writeIndex_
     void ensureWritableBytes(size_t len)
     {
         if (writableBytes() < len)
         {
+            if (segmented())
+            {
+                // 链接一个足够大的新块，已有数据保持不动
+                appendSegment(std::max(blockSize_, len));
+                return;
+            }
             // 扩容函数
             makeSpace(len);
         }
@@ -125,34 +291,175 @@ public:
     // 把[data, data+len]内存上的数据添加到缓冲区中
     void append(const char *data, size_t len)
     {
+        if (segmented())
+        {
+            appendSegmented(data, len);
+            return;
+        }
         ensureWritableBytes(len);
         std::copy(data, data+len, beginWrite());
         writerIndex_ += len;
     }
 
+    // 分段模式下先逐段查找，找不到时不合并（请求行还没收全时不拷贝），找到时与 peek() 一样合并
     const char* findCRLF() const
     {
+        if (segmented())
+        {
+            return findCRLFSegmented();
+        }
         // FIXME: replace with memmem()?
-        const char* crlf = std::search(peek(), beginWrite(), kCRLF, kCRLF+2);
-        return crlf == beginWrite() ? NULL : crlf;
+        const char* start = peek();
+        const char* end = start + readableBytes();
+        const char* crlf = std::search(start, end, kCRLF, kCRLF+2);
+        return crlf == end ? NULL : crlf;
     }
 
     char* beginWrite()
     {
+        if (segmented())
+        {
+            return segments_.empty() ? nullptr : segments_.back().end();
+        }
         return begin() + writerIndex_;
     }
 
     const char* beginWrite() const
     {
+        if (segmented())
+        {
+            return segments_.empty() ? nullptr : segments_.back().end();
+        }
         return begin() + writerIndex_;
     }
 
     // 从fd上读取数据
     ssize_t readFd(int fd, int *saveErrno);
-    // 通过fd发送数据
-    ssize_t writeFd(int fd, int *saveErrno);
+    // 通过fd发送数据（分段模式下使用writev），最多发送 maxBytes 字节
+    ssize_t writeFd(int fd, int *saveErrno, size_t maxBytes = SIZE_MAX);
     
 private:
+    // 分段模式下的一个分段：内存块以及其中 [readIndex, writeIndex) 的可读区间
+    struct Segment
+    {
+        BufferBlockPtr block;
+        size_t readIndex;
+        size_t writeIndex;
+
+        char* begin() const { return block->data() + readIndex; }
+        char* end() const { return block->data() + writeIndex; }
+        size_t readableBytes() const { return writeIndex - readIndex; }
+        size_t writableBytes() const { return block->capacity() - writeIndex; }
+    };
+
+    ssize_t readFdSegmented(int fd, int *saveErrno);
+    const char* findCRLFSegmented() const;
+    ssize_t writeFdSegmented(int fd, int *saveErrno, size_t maxBytes);
+
+    void appendSegment(size_t capacity)
+    {
+        segments_.push_back(Segment{std::make_shared<BufferBlock>(capacity), 0, 0});
+    }
+
+    void appendSegmented(const char *data, size_t len)
+    {
+        while (len > 0)
+        {
+            if (writableBytes() == 0)
+            {
+                appendSegment(blockSize_);
+            }
+            Segment &tail = segments_.back();
+            size_t n = std::min(len, tail.writableBytes());
+            ::memcpy(tail.end(), data, n);
+            tail.writeIndex += n;
+            segmentedBytes_ += n;
+            data += n;
+            len -= n;
+        }
+    }
+
+    void retrieveSegments(size_t len)
+    {
+        if (len >= segmentedBytes_)
+        {
+            retrieveAllSegments();
+            return;
+        }
+        segmentedBytes_ -= len;
+        size_t drained = 0;
+        while (len > 0)
+        {
+            Segment &seg = segments_[drained];
+            size_t n = std::min(len, seg.readableBytes());
+            seg.readIndex += n;
+            len -= n;
+            if (seg.readableBytes() == 0 && drained + 1 < segments_.size())
+            {
+                // 读空的块直接摘除；被切片引用的块由引用计数负责释放
+                ++drained;
+            }
+        }
+        segments_.erase(segments_.begin(), segments_.begin() + drained);
+    }
+
+    void retrieveAllSegments()
+    {
+        segmentedBytes_ = 0;
+        if (segments_.empty())
+        {
+            return;
+        }
+        // 尾块没有被切片引用时可以原地复用，省掉一次分配
+        Segment tail = segments_.back();
+        segments_.clear();
+        if (tail.block.use_count() == 1)
+        {
+            tail.readIndex = 0;
+            tail.writeIndex = 0;
+            segments_.push_back(std::move(tail));
+        }
+    }
+
+    /**
+     * 把可读数据合并到一个内存块中，保证 peek() 返回连续内存
+     * 新块按可读数据的两倍分配：之后 readFd 先填满这块的剩余空间，数据翻倍之前不会再产生新分段，
+     * 逐次读入的大消息反复 peek 时总的拷贝量是 O(n) 而不是每次都把全部数据再拷一遍
+     */
+    void pullup() const
+    {
+        if (segments_.size() <= 1 || segments_.front().readableBytes() == segmentedBytes_)
+        {
+            return;
+        }
+        Segment merged{std::make_shared<BufferBlock>(std::max(blockSize_, segmentedBytes_ * 2)), 0, 0};
+        copyOut(merged.block->data(), segmentedBytes_);
+        merged.writeIndex = segmentedBytes_;
+        segments_.clear();
+        segments_.push_back(std::move(merged));
+    }
+
+    // 把前 len 字节可读数据拷贝到 dst，不移动读指针
+    void copyOut(char *dst, size_t len) const
+    {
+        if (!segmented())
+        {
+            ::memcpy(dst, peek(), len);
+            return;
+        }
+        for (const Segment &seg : segments_)
+        {
+            if (len == 0)
+            {
+                break;
+            }
+            size_t n = std::min(len, seg.readableBytes());
+            ::memcpy(dst, seg.begin(), n);
+            dst += n;
+            len -= n;
+        }
+    }
+
     char* begin()
     {
         // 获取buffer_起始地址
@@ -194,6 +501,13 @@ private:
     std::vector<char> buffer_;
     size_t readerIndex_;
     size_t writerIndex_;
+
+    Mode mode_;
+    size_t blockSize_;                      // 分段模式下新块的大小
+    mutable std::vector<Segment> segments_; // 分段模式下的内存块链，peek() 时可能被 pullup 合并
+    size_t segmentedBytes_;                 // 分段模式下的可读字节总数
+    BufferBlockPtr spareBlock_;             // readFd 预留的备用块，未读入数据时下次复用
+
     static const char kCRLF[];
 };
 
@@ -11,6 +11,7 @@ Channel::Channel(EventLoop *loop, int fd)
         events_(0),
         revents_(0),
         index_(-1),
+        edgeTriggered_(false),
         tied_(false)
 {
 }
@@ -80,6 +81,7 @@ void Channel::handleEventWithGuard(Timestamp receiveTime)
         // 确认是否拥有回调函数
         if (closeCallback_)
         {
+            loop_->setActivity(EventLoop::kChannelClose);
             closeCallback_();
         }
     }
@@ -90,6 +92,7 @@ void Channel::handleEventWithGuard(Timestamp receiveTime)
         LOG_ERROR << "the fd = " << this->fd();
         if (errorCallback_)
         {
+            loop_->setActivity(EventLoop::kChannelError);
             errorCallback_();
         }
     }
@@ -101,6 +104,7 @@ void Channel::handleEventWithGuard(Timestamp receiveTime)
         if (readCallback_)
         {
             LOG_DEBUG << "channel call the readCallback_(), the fd = " << this->fd();
+            loop_->setActivity(EventLoop::kChannelRead);
             readCallback_(receiveTime);
         }
     }
@@ -110,6 +114,7 @@ void Channel::handleEventWithGuard(Timestamp receiveTime)
     {
         if (writeCallback_)
         {
+            loop_->setActivity(EventLoop::kChannelWrite);
             writeCallback_();
         }
     }
@@ -50,6 +50,11 @@ public:
     void disableWriting() { events_ &= ~kWriteEvent; update(); }
     void disableAll() { events_ &= kNoneEvent; update(); }
 
+    // 边缘触发：注册时附加 EPOLLET，回调必须自己读写到 EAGAIN（或把剩余工作挂到下一轮）
+    // 需要在首次 enableReading/enableWriting 之前设置
+    void setEdgeTriggered(bool on) { edgeTriggered_ = on; }
+    bool edgeTriggered() const { return edgeTriggered_; }
+
     // 返回fd当前的事件状态
     bool isNoneEvent() const { return events_ == kNoneEvent; }
     bool isWriting() const { return events_ & kWriteEvent; }
@@ -86,6 +91,7 @@ private:
     int events_;        // 注册fd感兴趣的事件
     int revents_;       // poller返回的具体发生的事件
     int index_;         // 在Poller上注册的情况
+    bool edgeTriggered_;    // 是否以 EPOLLET 方式注册
 
     std::weak_ptr<void> tie_;   // 弱指针指向TcpConnection(必要时升级为shared_ptr多一份引用计数，避免用户误删)
     bool tied_;  // 标志此 Channel 是否被调用过 Channel::tie 方法
@@ -0,0 +1,118 @@
+#ifndef CONNECTION_ALLOCATOR_H
+#define CONNECTION_ALLOCATOR_H
+
+#include <stddef.h>
+#include <new>
+
+/**
+ * 短连接快速路径中 TcpConnection 的分配器，配合 std::allocate_shared 使用
+ *
+ * 1. allocate_shared 把控制块和连接对象放在同一块内存里，一个连接只有一次分配
+ * 2. 释放的内存块挂到当前线程的空闲链表，同一线程下次分配时直接复用；
+ *    快速路径下连接在所属 IO 线程创建和析构，所以空闲链表实际上是每个 loop 一个，不需要加锁
+ * 3. 每个线程最多缓存 kMaxCachedBlocks 块，多出的直接还给系统，线程退出时全部释放
+ * 4. 内存块总是放回执行释放的线程的空闲链表：用户在其他线程持有最后一个 TcpConnectionPtr 时，
+ *    连接在那个线程析构，内存块就留在那个线程缓存（仍然无锁、正确），直到该线程再次分配或退出；
+ *    IO 线程的缓存因此变少，只是多走几次 operator new
+ */
+template <size_t Size>
+class ConnectionBlockCache
+{
+public:
+    static const size_t kMaxCachedBlocks = 1024;
+
+    static void* pop()
+    {
+        List &list = local();
+        Node *node = list.head;
+        if (node != nullptr)
+        {
+            list.head = node->next;
+            --list.count;
+        }
+        return node;
+    }
+
+    // 缓存已满时返回 false，由调用方释放
+    static bool push(void *block)
+    {
+        List &list = local();
+        if (list.count >= kMaxCachedBlocks)
+        {
+            return false;
+        }
+        Node *node = static_cast<Node*>(block);
+        node->next = list.head;
+        list.head = node;
+        ++list.count;
+        return true;
+    }
+
+private:
+    struct Node
+    {
+        Node *next;
+    };
+
+    struct List
+    {
+        Node *head = nullptr;
+        size_t count = 0;
+
+        ~List()
+        {
+            while (head != nullptr)
+            {
+                Node *next = head->next;
+                ::operator delete(head);
+                head = next;
+            }
+        }
+    };
+
+    static List& local()
+    {
+        static thread_local List list;
+        return list;
+    }
+};
+
+template <typename T>
+class ConnectionAllocator
+{
+public:
+    using value_type = T;
+
+    ConnectionAllocator() = default;
+    template <typename U>
+    ConnectionAllocator(const ConnectionAllocator<U>&) {}
+
+    T* allocate(size_t n)
+    {
+        if (n == 1)
+        {
+            void *block = ConnectionBlockCache<sizeof(T)>::pop();
+            if (block != nullptr)
+            {
+                return static_cast<T*>(block);
+            }
+        }
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T *p, size_t n)
+    {
+        if (n == 1 && ConnectionBlockCache<sizeof(T)>::push(p))
+        {
+            return;
+        }
+        ::operator delete(p);
+    }
+
+    template <typename U>
+    bool operator==(const ConnectionAllocator<U>&) const { return true; }
+    template <typename U>
+    bool operator!=(const ConnectionAllocator<U>&) const { return false; }
+};
+
+#endif // CONNECTION_ALLOCATOR_H
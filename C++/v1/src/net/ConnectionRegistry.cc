@@ -0,0 +1,83 @@
+#include "ConnectionRegistry.h"
+#include "TcpConnection.h"
+
+ConnectionRegistry::ConnectionRegistry(uint16_t shard)
+    : shard_(shard),
+      freeHead_(kNoFree),
+      size_(0)
+{
+}
+
+uint64_t ConnectionRegistry::add(const TcpConnectionPtr &conn)
+{
+    uint32_t index;
+    if (freeHead_ != kNoFree)
+    {
+        index = freeHead_;
+        freeHead_ = slots_[index].nextFree;
+        slots_[index].nextFree = kNoFree;
+    }
+    else
+    {
+        index = static_cast<uint32_t>(slots_.size());
+        slots_.emplace_back();
+    }
+    slots_[index].conn = conn;
+    ++size_;
+    return makeId(index);
+}
+
+const ConnectionRegistry::Slot* ConnectionRegistry::slotOf(uint64_t id) const
+{
+    uint32_t index = static_cast<uint32_t>(id);
+    if (shardOf(id) != shard_ || index >= slots_.size())
+    {
+        return nullptr;
+    }
+    const Slot &slot = slots_[index];
+    if (!slot.conn || slot.generation != static_cast<uint16_t>(id >> 48))
+    {
+        return nullptr;
+    }
+    return &slot;
+}
+
+bool ConnectionRegistry::remove(uint64_t id)
+{
+    if (slotOf(id) == nullptr)
+    {
+        return false;
+    }
+    uint32_t index = static_cast<uint32_t>(id);
+    Slot &slot = slots_[index];
+    slot.conn.reset();
+    // 代数回绕时跳过 0
+    if (++slot.generation == 0)
+    {
+        slot.generation = 1;
+    }
+    slot.nextFree = freeHead_;
+    freeHead_ = index;
+    --size_;
+    return true;
+}
+
+TcpConnectionPtr ConnectionRegistry::find(uint64_t id) const
+{
+    const Slot *slot = slotOf(id);
+    return slot != nullptr ? slot->conn : TcpConnectionPtr();
+}
+
+void ConnectionRegistry::takeAll(std::vector<TcpConnectionPtr> *conns)
+{
+    for (Slot &slot : slots_)
+    {
+        if (slot.conn)
+        {
+            conns->push_back(std::move(slot.conn));
+        }
+    }
+    slots_.clear();
+    freeHead_ = kNoFree;
+    size_ = 0;
+}
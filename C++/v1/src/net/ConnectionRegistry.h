@@ -0,0 +1,62 @@
+#ifndef CONNECTION_REGISTRY_H
+#define CONNECTION_REGISTRY_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "noncopyable.h"
+#include "Callback.h"
+
+/**
+ * 一个 IO 线程的连接登记表（槽表），只在所属 loop 线程访问，不需要加锁
+ *
+ * 1. 连接用 64 位 id 标识：高 16 位是槽的代数，中间 16 位是分片号（loop 的下标），低 32 位是槽下标
+ *    登记、注销、查找都是一次数组下标访问，不需要为每个连接拼接字符串和哈希
+ * 2. 注销的槽放进空闲链表复用，复用时代数加一，过期的 id 查不到新连接
+ */
+class ConnectionRegistry : noncopyable
+{
+public:
+    explicit ConnectionRegistry(uint16_t shard);
+
+    // 登记连接，返回分配的 id
+    uint64_t add(const TcpConnectionPtr &conn);
+    // 注销连接，id 已经过期时返回 false
+    bool remove(uint64_t id);
+    // 按 id 查找，找不到返回空指针
+    TcpConnectionPtr find(uint64_t id) const;
+
+    size_t size() const { return size_; }
+    uint16_t shard() const { return shard_; }
+
+    // 取出所有连接并清空，用于服务器析构时关闭连接
+    void takeAll(std::vector<TcpConnectionPtr> *conns);
+
+    static uint16_t shardOf(uint64_t id) { return static_cast<uint16_t>(id >> 32); }
+
+private:
+    static const uint32_t kNoFree = UINT32_MAX;
+
+    struct Slot
+    {
+        TcpConnectionPtr conn;
+        uint16_t generation = 1;    // 从 1 开始，保证 id 不为 0
+        uint32_t nextFree = kNoFree;
+    };
+
+    uint64_t makeId(uint32_t index) const
+    {
+        return static_cast<uint64_t>(slots_[index].generation) << 48
+            | static_cast<uint64_t>(shard_) << 32
+            | index;
+    }
+    // id 指向的槽，id 过期或不属于本分片时返回 nullptr
+    const Slot* slotOf(uint64_t id) const;
+
+    const uint16_t shard_;
+    std::vector<Slot> slots_;
+    uint32_t freeHead_;     // 空闲槽链表头
+    size_t size_;
+};
+
+#endif // CONNECTION_REGISTRY_H
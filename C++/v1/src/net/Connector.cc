@@ -0,0 +1,311 @@
+#include "Connector.h"
+#include "Channel.h"
+#include "EventLoop.h"
+#include "WeakCallback.h"
+#include "Logging.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+const double Connector::kDefaultConnectTimeout = 3.0;
+const double Connector::kInitialRetryDelay = 0.5;
+const double Connector::kMaxRetryDelay = 30.0;
+
+namespace
+{
+    int getSocketError(int sockfd)
+    {
+        int optval = 0;
+        socklen_t optlen = sizeof(optval);
+        if (::getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &optval, &optlen) < 0)
+        {
+            return errno;
+        }
+        return optval;
+    }
+
+    // 连接本机的临时端口时可能连上自己（源端口和目的端口相同）
+    bool isSelfConnect(int sockfd)
+    {
+        sockaddr_in local;
+        sockaddr_in peer;
+        socklen_t len = sizeof(local);
+        ::memset(&local, 0, sizeof(local));
+        ::memset(&peer, 0, sizeof(peer));
+        if (::getsockname(sockfd, (sockaddr *)&local, &len) < 0)
+        {
+            return false;
+        }
+        len = sizeof(peer);
+        if (::getpeername(sockfd, (sockaddr *)&peer, &len) < 0)
+        {
+            return false;
+        }
+        return local.sin_port == peer.sin_port && local.sin_addr.s_addr == peer.sin_addr.s_addr;
+    }
+}
+
+Connector::Connector(EventLoop *loop, const InetAddress &serverAddr)
+    : loop_(loop)
+    , serverAddr_(serverAddr)
+    , connect_(false)
+    , state_(kDisconnected)
+    , connectTimeout_(kDefaultConnectTimeout)
+    , initialRetryDelay_(kInitialRetryDelay)
+    , maxRetryDelay_(kMaxRetryDelay)
+    , retryDelay_(kInitialRetryDelay)
+{
+}
+
+Connector::~Connector()
+{
+    // 定时器和 channel 的回调都只持有弱引用，这里不需要取消
+    if (channel_)
+    {
+        // 仍在连接：channel 可能还在本轮的活跃列表中，不能在这里释放，交给 loop 线程注销并关闭
+        std::shared_ptr<Channel> channel(std::move(channel_));
+        if (loop_->isInLoopThread())
+        {
+            channel->disableAll();
+            channel->remove();
+            ::close(channel->fd());
+            loop_->queueInLoop([channel]() {});
+        }
+        else
+        {
+            loop_->queueInLoop([channel]() {
+                channel->disableAll();
+                channel->remove();
+                ::close(channel->fd());
+            });
+        }
+    }
+}
+
+void Connector::start()
+{
+    connect_ = true;
+    loop_->runInLoop(makeWeakCallback(shared_from_this(), &Connector::startInLoop));
+}
+
+void Connector::startInLoop()
+{
+    if (connect_ && state_ == kDisconnected)
+    {
+        connect();
+    }
+}
+
+void Connector::stop()
+{
+    connect_ = false;
+    if (loop_->isInLoopThread())
+    {
+        // 在 loop 线程中立即注销 channel，调用方随后可以安全地销毁 Connector
+        stopInLoop();
+    }
+    else
+    {
+        loop_->queueInLoop(makeWeakCallback(shared_from_this(), &Connector::stopInLoop));
+    }
+}
+
+void Connector::stopInLoop()
+{
+    if (retryTimer_.valid())
+    {
+        loop_->cancel(retryTimer_);
+        retryTimer_ = TimerId();
+    }
+    if (state_ == kConnecting)
+    {
+        cancelTimeout();
+        ::close(removeAndResetChannel());
+        setState(kDisconnected);
+    }
+}
+
+void Connector::connectionClosed()
+{
+    if (state_ == kConnected)
+    {
+        setState(kDisconnected);
+    }
+}
+
+void Connector::restart()
+{
+    setState(kDisconnected);
+    retryDelay_ = initialRetryDelay_;
+    connect_ = true;
+    startInLoop();
+}
+
+void Connector::connect()
+{
+    int sockfd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP);
+    if (sockfd < 0)
+    {
+        LOG_ERROR << "Connector::connect socket err " << errno;
+        retry(-1);
+        return;
+    }
+    int ret = ::connect(sockfd, (sockaddr *)serverAddr_.getSockAddr(), sizeof(sockaddr_in));
+    int savedErrno = (ret == 0) ? 0 : errno;
+    switch (savedErrno)
+    {
+    case 0:
+    case EINPROGRESS:
+    case EINTR:
+    case EISCONN:
+        connecting(sockfd);
+        break;
+
+    // 暂时性的错误，稍后重试
+    case EAGAIN:
+    case EADDRINUSE:
+    case EADDRNOTAVAIL:
+    case ECONNREFUSED:
+    case ENETUNREACH:
+    case ETIMEDOUT:
+        retry(sockfd);
+        break;
+
+    default:
+        // 地址不合法等，重试也不会成功
+        LOG_ERROR << "Connector::connect to " << serverAddr_.toIpPort() << " error " << savedErrno;
+        ::close(sockfd);
+        connect_ = false;
+        if (connectFailedCallback_)
+        {
+            connectFailedCallback_();
+        }
+        break;
+    }
+}
+
+void Connector::connecting(int sockfd)
+{
+    setState(kConnecting);
+    channel_.reset(new Channel(loop_, sockfd));
+    // Connector 可能先于 channel 销毁（见析构函数），回调只持有弱引用
+    channel_->setWriteCallback(makeWeakCallback(shared_from_this(), &Connector::handleWrite));
+    channel_->setErrorCallback(makeWeakCallback(shared_from_this(), &Connector::handleError));
+    channel_->enableWriting();
+    if (connectTimeout_ > 0.0)
+    {
+        std::weak_ptr<Connector> weakSelf(shared_from_this());
+        timeoutTimer_ = loop_->runAfter(connectTimeout_, [weakSelf, sockfd]() {
+            std::shared_ptr<Connector> self(weakSelf.lock());
+            if (self)
+            {
+                self->handleTimeout(sockfd);
+            }
+        });
+    }
+}
+
+int Connector::removeAndResetChannel()
+{
+    channel_->disableAll();
+    channel_->remove();
+    int sockfd = channel_->fd();
+    // 可能正在这个 channel 的 handleEvent 中，把它本身移交给队列，本轮末尾销毁；
+    // 不能推迟去重置 channel_，那时 channel_ 可能已经是之后新建的 channel
+    std::shared_ptr<Channel> removed(std::move(channel_));
+    loop_->queueInLoop([removed]() {});
+    return sockfd;
+}
+
+void Connector::cancelTimeout()
+{
+    if (timeoutTimer_.valid())
+    {
+        loop_->cancel(timeoutTimer_);
+        timeoutTimer_ = TimerId();
+    }
+}
+
+void Connector::handleWrite()
+{
+    // 同一次事件里 handleError 可能已经放弃了这个 sockfd
+    if (state_ != kConnecting)
+    {
+        return;
+    }
+    cancelTimeout();
+    int sockfd = removeAndResetChannel();
+    int err = getSocketError(sockfd);
+    if (err)
+    {
+        LOG_WARN << "Connector::handleWrite - SO_ERROR = " << err << " " << strerror(err);
+        retry(sockfd);
+    }
+    else if (isSelfConnect(sockfd))
+    {
+        LOG_WARN << "Connector::handleWrite - Self connect";
+        retry(sockfd);
+    }
+    else
+    {
+        setState(kConnected);
+        retryDelay_ = initialRetryDelay_;
+        if (connect_ && newConnectionCallback_)
+        {
+            newConnectionCallback_(sockfd);
+        }
+        else
+        {
+            ::close(sockfd);
+            setState(kDisconnected);
+        }
+    }
+}
+
+void Connector::handleError()
+{
+    if (state_ != kConnecting)
+    {
+        return;
+    }
+    cancelTimeout();
+    int sockfd = removeAndResetChannel();
+    LOG_WARN << "Connector::handleError - SO_ERROR = " << getSocketError(sockfd);
+    retry(sockfd);
+}
+
+void Connector::handleTimeout(int sockfd)
+{
+    timeoutTimer_ = TimerId();
+    if (state_ != kConnecting || !channel_ || channel_->fd() != sockfd)
+    {
+        return;
+    }
+    LOG_WARN << "Connector::connect to " << serverAddr_.toIpPort() << " timeout";
+    retry(removeAndResetChannel());
+}
+
+void Connector::retry(int sockfd)
+{
+    if (sockfd >= 0)
+    {
+        ::close(sockfd);
+    }
+    setState(kDisconnected);
+    // 回调中可能 stop，因此先于重试调用
+    if (connectFailedCallback_)
+    {
+        connectFailedCallback_();
+    }
+    if (connect_)
+    {
+        LOG_INFO << "Connector::retry - Retry connecting to " << serverAddr_.toIpPort()
+                 << " in " << retryDelay_ << " seconds";
+        retryTimer_ = loop_->runAfter(retryDelay_,
+                                      makeWeakCallback(shared_from_this(), &Connector::startInLoop));
+        retryDelay_ = std::min(retryDelay_ * 2, maxRetryDelay_);
+    }
+}
@@ -0,0 +1,97 @@
+#ifndef CONNECTOR_H
+#define CONNECTOR_H
+
+#include <functional>
+#include <atomic>
+#include <memory>
+
+#include "noncopyable.h"
+#include "InetAddress.h"
+#include "TimerId.h"
+
+class Channel;
+class EventLoop;
+
+/**
+ * 非阻塞地发起 TCP 连接，TcpClient 使用
+ *
+ * 1. connect 返回 EINPROGRESS 后把 sockfd 注册写事件，可写时用 SO_ERROR 判断是否连上
+ * 2. 超过 connectTimeout 还没连上则关闭 sockfd 重试
+ * 3. 失败后按指数退避重试，间隔从 initialRetryDelay 开始翻倍，不超过 maxRetryDelay
+ *
+ * 连上之后把 sockfd 交给 NewConnectionCallback，之后 Connector 不再持有它；
+ * 每次连接失败（包括超时）都会先调用 ConnectFailedCallback，回调中可以 stop 以放弃重试
+ * 除 start / stop 外只能在 loop 线程调用
+ */
+class Connector : noncopyable, public std::enable_shared_from_this<Connector>
+{
+public:
+    using NewConnectionCallback = std::function<void(int sockfd)>;
+    using ConnectFailedCallback = std::function<void()>;
+
+    static const double kDefaultConnectTimeout;     // 秒
+    static const double kInitialRetryDelay;
+    static const double kMaxRetryDelay;
+
+    Connector(EventLoop *loop, const InetAddress &serverAddr);
+    ~Connector();
+
+    void setNewConnectionCallback(const NewConnectionCallback &cb) { newConnectionCallback_ = cb; }
+    void setConnectFailedCallback(const ConnectFailedCallback &cb) { connectFailedCallback_ = cb; }
+    // 连接超时，0 表示不限制（由内核的 SYN 重传决定）
+    void setConnectTimeout(double seconds) { connectTimeout_ = seconds; }
+    void setRetryDelay(double initialSeconds, double maxSeconds)
+    {
+        initialRetryDelay_ = initialSeconds;
+        maxRetryDelay_ = maxSeconds;
+        retryDelay_ = initialSeconds;
+    }
+
+    // 可跨线程调用；在 loop 线程中调用 stop 会立即关闭正在连接的 sockfd
+    void start();
+    void stop();
+    // 连接断开后重新连接，退避间隔从头开始，只能在 loop 线程调用
+    void restart();
+    // 交出去的连接断开后调用（不重连时），之后 start 才能重新连接，只能在 loop 线程调用
+    void connectionClosed();
+
+    const InetAddress& serverAddress() const { return serverAddr_; }
+
+private:
+    enum States
+    {
+        kDisconnected,
+        kConnecting,
+        kConnected,
+    };
+
+    void setState(States s) { state_ = s; }
+    void startInLoop();
+    void stopInLoop();
+    void connect();
+    void connecting(int sockfd);
+    void handleWrite();
+    void handleError();
+    void handleTimeout(int sockfd);
+    // 放弃当前的 sockfd，按退避间隔重试
+    void retry(int sockfd);
+    // 注销 channel 并返回其 sockfd，channel 本身在本轮末尾销毁（此时可能正处在它的回调中）
+    int removeAndResetChannel();
+    void cancelTimeout();
+
+    EventLoop *loop_;
+    InetAddress serverAddr_;
+    std::atomic_bool connect_;  // 是否需要连接（stop 之后为 false），start / stop 可跨线程写
+    States state_;
+    std::unique_ptr<Channel> channel_;
+    NewConnectionCallback newConnectionCallback_;
+    ConnectFailedCallback connectFailedCallback_;
+    double connectTimeout_;
+    double initialRetryDelay_;
+    double maxRetryDelay_;
+    double retryDelay_;         // 下一次重试的间隔
+    TimerId timeoutTimer_;      // 本次连接的超时定时器
+    TimerId retryTimer_;
+};
+
+#endif // CONNECTOR_H
@@ -1,6 +1,7 @@
 #include "EventLoop.h"
 #include "Logging.h"
 #include "Poller.h"
+#include "LoopClock.h"
 #include <unistd.h>
 #include <sys/eventfd.h>
 #include <fcntl.h>
@@ -22,12 +23,28 @@ int createEventfd()
     return evfd;
 }
 
-EventLoop::EventLoop() : 
+EventLoop::EventLoop(PollerBackend backend) : 
     looping_(false),
     quit_(false),
     callingPendingFunctors_(false),
+    wakeupPending_(false),
     threadId_(CurrentThread::tid()),
-    poller_(Poller::newDefaultPoller(this)),
+    cpu_(-1),
+    pollReturnMonotonic_(0),
+    busyPollMicroSeconds_(0),
+    spinPolls_(0),
+    spinHits_(0),
+    blockingPolls_(0),
+    numConnections_(0),
+    pendingFunctorCount_(0),
+    activeChannelCount_(0),
+    recentBusyMicroSeconds_(0),
+    metricsEnabled_(false),
+    iterationSeq_(0),
+    busySince_(0),
+    currentFd_(-1),
+    currentActivity_(kPolling),
+    poller_(Poller::newDefaultPoller(this, backend)),
     timerQueue_(new TimerQueue(this)),
     wakeupFd_(createEventfd()),
     wakeupChannel_(new Channel(this, wakeupFd_)),
@@ -68,28 +85,123 @@ void EventLoop::loop()
     quit_ = false;
 
     LOG_INFO << "EventLoop " << this << " start looping";
+    // 上一轮结束的时刻，即本轮进入 poll 的时刻
+    int64_t iterationEnd = LoopClock::monotonicMicroSeconds();
 
     while (!quit_)
     {
         // 清空activeChannels_
         activeChannels_.clear();
-        // 获取
-        pollReturnTime_ = poller_->poll(kPollTimeMs, &activeChannels_);
-        for (Channel *channel : activeChannels_)
+        busySince_.store(0, std::memory_order_relaxed);
+        setActivity(kPolling);
+        // 忙轮询窗口内不阻塞，窗口外按默认超时阻塞等待
+        int64_t busyPoll = busyPollMicroSeconds_.load(std::memory_order_relaxed);
+        // 用上一次poll返回的时间判断，不额外取时间
+        bool spinning = busyPoll > 0
+            && pollReturnTime_.microSecondsSinceEpoch() - lastActiveTime_.microSecondsSinceEpoch() < busyPoll;
+        if (timerQueue_->pollMode())
         {
+            // 定时器并入 poll 超时：等到最早的定时器到期为止，不经过 timerfd
+            int64_t timeoutUs = spinning ? 0 : static_cast<int64_t>(kPollTimeMs) * 1000;
+            int64_t timerUs = spinning ? -1 : timerQueue_->nextTimeoutMicroSeconds(timerQueue_->monotonicNow());
+            if (timerUs >= 0 && timerUs < timeoutUs)
+            {
+                timeoutUs = timerUs;
+            }
+            pollReturnTime_ = poller_->pollMicroSeconds(timeoutUs, &activeChannels_);
+        }
+        else
+        {
+            // 获取
+            pollReturnTime_ = poller_->poll(spinning ? 0 : kPollTimeMs, &activeChannels_);
+        }
+        pollReturnMonotonic_ = LoopClock::monotonic();
+        // 先发布新的序号再写开始时间，读方按序号判断读到的是不是同一轮
+        iterationSeq_.store(iterationSeq_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        busySince_.store(pollReturnMonotonic_, std::memory_order_relaxed);
+        bool metrics = metricsEnabled_.load(std::memory_order_relaxed);
+        if (metrics)
+        {
+            metrics_.pollWaitMicroSeconds.record(pollReturnMonotonic_ - iterationEnd);
+            metrics_.eventsPerPoll.record(static_cast<int64_t>(activeChannels_.size()));
+        }
+        activeChannelCount_.store(static_cast<int>(activeChannels_.size()), std::memory_order_relaxed);
+        if (!activeChannels_.empty())
+        {
+            lastActiveTime_ = pollReturnTime_;
+        }
+        // 计数器只有本线程写，不需要原子加
+        if (spinning)
+        {
+            spinPolls_.store(spinPolls_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            if (!activeChannels_.empty())
+            {
+                spinHits_.store(spinHits_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            }
+        }
+        else
+        {
+            blockingPolls_.store(blockingPolls_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+        // 上一个回调结束的时刻就是下一个回调开始的时刻，打开统计时每个 channel 只读一次时钟
+        int64_t start = pollReturnMonotonic_;
+        for (const Poller::ActiveChannel &active : activeChannels_)
+        {
+            // 本批中前面的回调可能已经移除或释放了它
+            if (!poller_->stillActive(active))
+            {
+                continue;
+            }
+            Channel *channel = active.channel;
+            currentActiveChannel_ = channel;
+            currentFd_.store(active.fd, std::memory_order_relaxed);
             channel->handleEvent(pollReturnTime_);
+            if (metrics)
+            {
+                int64_t end = LoopClock::monotonicMicroSeconds();
+                metrics_.handleEventMicroSeconds.record(end - start);
+                start = end;
+            }
+        }
+        currentActiveChannel_ = nullptr;
+        currentFd_.store(-1, std::memory_order_relaxed);
+        if (timerQueue_->pollMode())
+        {
+            timerQueue_->runExpired(timerQueue_->monotonicNow());
         }
         // 执行当前EventLoop事件循环需要处理的回调操作
         /**
          * IO thread：mainLoop accept fd 打包成 chennel 分发给 subLoop
          * mainLoop实现注册一个回调，交给subLoop来执行，wakeup subLoop 之后，让其执行注册的回调操作
-         * 这些回调函数在 std::vector<Functor> pendingFunctors_; 之中
+         * 这些回调函数在 MpscQueue<Functor> pendingFunctors_; 之中
          */
         doPendingFunctors();
+
+        // 本轮耗时的滑动平均（权重 1/8），空闲的轮次会把它拉回 0
+        iterationEnd = LoopClock::monotonicMicroSeconds();
+        int64_t busy = iterationEnd - pollReturnMonotonic_;
+        int64_t avg = recentBusyMicroSeconds_.load(std::memory_order_relaxed);
+        recentBusyMicroSeconds_.store(avg + (busy - avg) / 8, std::memory_order_relaxed);
     }
     looping_ = false;    
 }
 
+const char* EventLoop::activityName(Activity activity)
+{
+    switch (activity)
+    {
+    case kPolling:          return "poll";
+    case kChannelClose:     return "close callback";
+    case kChannelError:     return "error callback";
+    case kChannelRead:      return "read callback";
+    case kChannelWrite:     return "write callback";
+    case kTimers:           return "timer callback";
+    case kPendingFunctors:  return "queued functor";
+    case kIterationEnd:     return "iteration end functor";
+    }
+    return "unknown";
+}
+
 void EventLoop::quit()
 {
     quit_ = true;
@@ -100,7 +212,7 @@ void EventLoop::quit()
      * 比如在工作线程(subLoop)中调用了IO线程(mainLoop)
      * 这种情况会唤醒主线程
      */
-    if (isInLoopThread())
+    if (!isInLoopThread())
     {
         wakeup();
     }
@@ -118,16 +230,15 @@ void EventLoop::runInLoop(Functor cb)
     // 在非当前eventLoop线程中执行回调函数，需要唤醒evevntLoop所在线程
     else
     {
-        queueInLoop(cb);
+        queueInLoop(std::move(cb));
     }
 }
 
 void EventLoop::queueInLoop(Functor cb)
 {
-    {
-        std::unique_lock<std::mutex> lock(mutex_);
-        pendingFunctors_.emplace_back(cb); // 使用了std::move
-    }
+    // 无锁入队，生产者之间不再争抢 mutex_
+    pendingFunctors_.push(std::move(cb)); // 移动而不是拷贝，回调中携带的数据不会被复制
+    pendingFunctorCount_.fetch_add(1, std::memory_order_relaxed);
 
     // 唤醒相应的，需要执行上面回调操作的loop线程
     /** 
@@ -135,14 +246,25 @@ void EventLoop::queueInLoop(Functor cb)
      * std::atomic_bool callingPendingFunctors_; 标志当前loop是否有需要执行的回调操作
      * 这个 || callingPendingFunctors_ 比较有必要，因为在执行回调的过程可能会加入新的回调
      * 则这个时候也需要唤醒，否则就会发生有事件到来但是仍被阻塞住的情况
+     *
+     * 多个线程同时投递时只需要一次 eventfd 写：wakeupPending_ 已经为 true 说明
+     * 别的线程已经唤醒过、loop 还没开始取回调，本次入队的回调一定会被那一轮取到
      */
     if (!isInLoopThread() || callingPendingFunctors_)
     {
-        // 唤醒loop所在的线程
-        wakeup();
+        if (!wakeupPending_.exchange(true, std::memory_order_acq_rel))
+        {
+            // 唤醒loop所在的线程
+            wakeup();
+        }
     }
 }
 
+void EventLoop::runAtIterationEnd(Functor cb)
+{
+    iterationEndFunctors_.emplace_back(std::move(cb));
+}
+
 void EventLoop::wakeup()
 {
     uint64_t one = 1;
@@ -180,23 +302,41 @@ bool EventLoop::hasChannel(Channel *channel)
 
 void EventLoop::doPendingFunctors()
 {
-    std::vector<Functor> functors;
     callingPendingFunctors_ = true;
 
     /**
-     * TODO:
-     * 如果没有生成这个局部的 functors
-     * 则在互斥锁加持下，我们直接遍历pendingFunctors
-     * 其他线程这个时候无法访问，无法向里面注册回调函数，增加服务器时延
+     * 先清除唤醒标志再取回调：清除之后入队的生产者会重新写 eventfd，不会丢失唤醒
+     * exchange 与生产者的 exchange 同步，保证能看到清除之前已经完成入队的回调
      */
+    wakeupPending_.exchange(false, std::memory_order_acq_rel);
+    setActivity(kPendingFunctors);
+
+    // 只执行进入时已经在队列里的回调，执行过程中新投递的留到下一轮（与原先 swap 的语义相同）
+    size_t count = pendingFunctors_.consume([](Functor &functor) { functor(); });
+    if (count > 0)
     {
-        std::unique_lock<std::mutex> lock(mutex_);
-        functors.swap(pendingFunctors_);
+        pendingFunctorCount_.fetch_sub(static_cast<int64_t>(count), std::memory_order_relaxed);
+        if (metricsEnabled_.load(std::memory_order_relaxed))
+        {
+            metrics_.functorBatch.record(static_cast<int64_t>(count));
+        }
     }
 
-    for (const Functor &functor : functors)
+    // 本轮所有事件和回调都处理完了，再执行合并到末尾的工作
+    // 此时 callingPendingFunctors_ 仍为 true，其中 queueInLoop 的回调会唤醒下一轮
+    if (!iterationEndFunctors_.empty())
     {
-        functor();
+        setActivity(kIterationEnd);
+        std::vector<Functor> endFunctors;
+        endFunctors.swap(iterationEndFunctors_);
+        for (const Functor &functor : endFunctors)
+        {
+            functor();
+        }
+        if (!iterationEndFunctors_.empty())
+        {
+            wakeup();
+        }
     }
 
     callingPendingFunctors_ = false;
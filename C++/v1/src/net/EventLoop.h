@@ -5,27 +5,43 @@
 #include "Timestamp.h"
 #include "CurrentThread.h"
 #include "TimerQueue.h"
+#include "MpscQueue.h"
+#include "Task.h"
+#include "LoopMetrics.h"
+#include "Poller.h"
 #include <functional>
 #include <vector>
 #include <memory>
 #include <atomic>
-#include <mutex>
 
 class Channel;
-class Poller;
+
+// IO 复用后端，kDefault 表示按环境变量选择（MUDUO_USE_URING 选 io_uring，否则 epoll）
+enum class PollerBackend
+{
+    kDefault,
+    kEpoll,
+    kIoUring,
+};
+
 // 事件循环类 主要包含了两大模块，channel poller
 class EventLoop : noncopyable
 {
 public:
-    using Functor = std::function<void()>;
+    // 只能移动的任务类型，小的绑定对象直接存放在 Task 内部，队列节点复用（见 MpscQueue），投递时不做堆分配
+    using Functor = Task;
 
-    EventLoop();
+    explicit EventLoop(PollerBackend backend = PollerBackend::kDefault);
     ~EventLoop();
 
     void loop();
     void quit();
+    // loop() 是否正在运行，可跨线程调用
+    bool looping() const { return looping_; }
 
     Timestamp pollReturnTime() const { return pollReturnTime_; }
+    // poll 返回时的单调时间（微秒），与 pollReturnTime 是同一次读时钟（见 LoopClock）
+    int64_t pollReturnMonotonic() const { return pollReturnMonotonic_; }
 
     // 在当前线程同步调用函数
     void runInLoop(Functor cb);
@@ -39,6 +55,12 @@ public:
      */
     void queueInLoop(Functor cb);
 
+    /**
+     * 注册在本轮循环末尾（doPendingFunctors 之后）执行的回调，只能在loop线程调用
+     * 用来把一轮里产生的零散工作合并成一次处理，例如 TcpConnection 的合并写
+     */
+    void runAtIterationEnd(Functor cb);
+
     // 用来唤醒loop所在的线程
     void wakeup();
 
@@ -47,35 +69,135 @@ public:
     void removeChannel(Channel *channel);
     bool hasChannel(Channel *channel);
 
+    /**
+     * 忙轮询：最近一次有事件后的 spinSeconds 秒内用 0 超时轮询，不进入阻塞等待，
+     * 省掉被唤醒时的调度开销；超过窗口仍然空闲再退回阻塞。0 表示关闭，可跨线程设置
+     */
+    void setBusyPoll(double spinSeconds)
+    { busyPollMicroSeconds_.store(static_cast<int64_t>(spinSeconds * Timestamp::kMicroSecondsPerSecond)); }
+
+    // 忙轮询统计：0 超时轮询次数、其中拿到事件的次数、阻塞等待次数，用于调整窗口
+    int64_t spinPolls() const { return spinPolls_.load(std::memory_order_relaxed); }
+    int64_t spinHits() const { return spinHits_.load(std::memory_order_relaxed); }
+    int64_t blockingPolls() const { return blockingPolls_.load(std::memory_order_relaxed); }
+
+    /**
+     * 负载计数，供 EventLoopThreadPool 的分配策略读取，均为 relaxed 原子量，只反映近似值
+     * numConnections：分配到本 loop 的连接数，由 TcpServer 维护
+     * pendingFunctors：已投递还没执行的回调数
+     * activeChannels：最近一次 poll 返回的活跃 channel 数
+     * recentBusyMicroSeconds：每轮处理耗时（poll 返回到本轮结束）的指数滑动平均
+     */
+    void addConnections(int delta) { numConnections_.fetch_add(delta, std::memory_order_relaxed); }
+    int numConnections() const { return numConnections_.load(std::memory_order_relaxed); }
+    int64_t pendingFunctors() const { return pendingFunctorCount_.load(std::memory_order_relaxed); }
+    int activeChannels() const { return activeChannelCount_.load(std::memory_order_relaxed); }
+    int64_t recentBusyMicroSeconds() const { return recentBusyMicroSeconds_.load(std::memory_order_relaxed); }
+
+    /**
+     * 运行时统计（见 LoopMetrics）：poll 等待时间、每次 poll 的事件数、每个 channel 回调耗时、
+     * 跨线程回调批大小和定时器延迟。默认关闭，打开后每个活跃 channel 多读一次时钟，可跨线程设置
+     */
+    void setMetricsEnabled(bool on) { metricsEnabled_.store(on, std::memory_order_relaxed); }
+    bool metricsEnabled() const { return metricsEnabled_.load(std::memory_order_relaxed); }
+    // 只由 loop 线程写，其它线程可以随时读取快照
+    LoopMetrics& metrics() { return metrics_; }
+    const LoopMetrics& metrics() const { return metrics_; }
+
+    // loop 线程绑定的 CPU（见 CpuAffinity），-1 表示未绑定
+    int cpu() const { return cpu_; }
+    void setCpu(int cpu) { cpu_ = cpu; }
+
     // 判断EventLoop是否在自己的线程
     bool isInLoopThread() const { return threadId_ == CurrentThread::tid(); }
+    pid_t threadId() const { return threadId_; }
+
+    // loop 线程当前在做什么，供 StallWatchdog 在其它线程读取
+    enum Activity
+    {
+        kPolling,           // 阻塞在 poll 中
+        kChannelClose,      // Channel 的各类回调
+        kChannelError,
+        kChannelRead,
+        kChannelWrite,
+        kTimers,            // 定时器回调
+        kPendingFunctors,   // queueInLoop 投递的回调
+        kIterationEnd,      // runAtIterationEnd 注册的回调
+    };
+    static const char* activityName(Activity activity);
 
     /**
-     * 定时任务相关函数
+     * 心跳：每轮 poll 返回时 iterationSeq 加一，busySince 记为 poll 返回的单调时间（微秒），
+     * 进入 poll 前清零。其它线程先读 iterationSeq 再读其余字段，iterationSeq 不变时读到的属于同一轮
      */
-    void runAt(Timestamp timestamp, Functor&& cb) {
-        timerQueue_->addTimer(std::move(cb), timestamp, 0.0);
+    uint64_t iterationSeq() const { return iterationSeq_.load(std::memory_order_acquire); }
+    int64_t busySince() const { return busySince_.load(std::memory_order_relaxed); }
+    int currentFd() const { return currentFd_.load(std::memory_order_relaxed); }
+    Activity currentActivity() const { return static_cast<Activity>(currentActivity_.load(std::memory_order_relaxed)); }
+    // 只能在loop线程调用
+    void setActivity(Activity activity) { currentActivity_.store(activity, std::memory_order_relaxed); }
+
+    /**
+     * 定时任务相关函数，返回的 TimerId 可用于 cancel
+     */
+    TimerId runAt(Timestamp timestamp, Functor&& cb) {
+        return timerQueue_->addTimer(std::move(cb), timestamp, 0.0);
+    }
+
+    TimerId runAfter(double waitTime, Functor&& cb) {
+        return timerQueue_->addTimerAfter(std::move(cb), waitTime, 0.0);
+    }
+
+    TimerId runEvery(double interval, Functor&& cb) {
+        return timerQueue_->addTimerAfter(std::move(cb), interval, interval);
     }
 
-    void runAfter(double waitTime, Functor&& cb) {
-        Timestamp time(addTime(Timestamp::now(), waitTime)); 
-        runAt(time, std::move(cb));
+    // 取消定时器，可跨线程调用；已经执行完的一次性定时器会被忽略
+    void cancel(TimerId timerId) {
+        timerQueue_->cancel(timerId);
+    }
+
+    /**
+     * 定时器并入 poll 超时，不再使用 timerfd（见 TimerQueue::setPollMode）
+     * 默认由环境变量 MUDUO_TIMER_IN_POLL 决定，可跨线程设置
+     */
+    void setTimersInPoll(bool on) {
+        timerQueue_->setPollMode(on);
     }
 
-    void runEvery(double interval, Functor&& cb) {
-        Timestamp timestamp(addTime(Timestamp::now(), interval)); 
-        timerQueue_->addTimer(std::move(cb), timestamp, interval);
+    // 定时器使用本线程缓存的时钟（见 TimerQueue::setUseCachedClock），需在 loop 之前设置
+    void setTimersUseCachedClock(bool on) {
+        timerQueue_->setUseCachedClock(on);
     }
 private:
     void handleRead();
     void doPendingFunctors();
 
-    using ChannelList = std::vector<Channel*>;
+    using ChannelList = Poller::ChannelList;
     std::atomic_bool looping_;  // 原子操作，通过CAS实现
     std::atomic_bool quit_;     // 标志退出事件循环
     std::atomic_bool callingPendingFunctors_; // 标志当前loop是否有需要执行的回调操作
+    std::atomic_bool wakeupPending_;          // 已经写过 eventfd 且loop还没开始处理回调
     const pid_t threadId_;      // 记录当前loop所在线程的id
+    int cpu_;                   // 绑定的 CPU，-1 表示未绑定
     Timestamp pollReturnTime_;  // poller返回发生事件的channels的返回时间
+    int64_t pollReturnMonotonic_;   // 同一时刻的单调时间
+    Timestamp lastActiveTime_;  // 最近一次poll到事件的时间，决定是否继续忙轮询
+
+    std::atomic<int64_t> busyPollMicroSeconds_; // 忙轮询窗口，0 表示关闭
+    std::atomic<int64_t> spinPolls_;            // 只由loop线程写
+    std::atomic<int64_t> spinHits_;
+    std::atomic<int64_t> blockingPolls_;
+    std::atomic<int> numConnections_;
+    std::atomic<int64_t> pendingFunctorCount_;
+    std::atomic<int> activeChannelCount_;       // 以下两个只由loop线程写
+    std::atomic<int64_t> recentBusyMicroSeconds_;
+    std::atomic_bool metricsEnabled_;
+    LoopMetrics metrics_;
+    std::atomic<uint64_t> iterationSeq_;        // 心跳，以下三个只由loop线程写
+    std::atomic<int64_t> busySince_;
+    std::atomic<int> currentFd_;                // 正在处理的 channel 的 fd，-1 表示没有
+    std::atomic<int> currentActivity_;
     std::unique_ptr<Poller> poller_;
     std::unique_ptr<TimerQueue> timerQueue_;
     
@@ -89,8 +211,8 @@ private:
 
     ChannelList activeChannels_;            // 活跃的Channel
     Channel* currentActiveChannel_;         // 当前处理的活跃channel
-    std::mutex mutex_;                      // 用于保护pendingFunctors_线程安全操作
-    std::vector<Functor> pendingFunctors_;  // 存储loop跨线程需要执行的所有回调操作
+    MpscQueue<Functor> pendingFunctors_;    // 存储loop跨线程需要执行的所有回调操作，无锁入队，节点复用
+    std::vector<Functor> iterationEndFunctors_; // 本轮末尾执行的回调，只在loop线程访问
 };
 
 
@@ -1,5 +1,6 @@
 #include "EventLoopThread.h"
 #include "EventLoop.h"
+#include "CpuAffinity.h"
 
 EventLoopThread::EventLoopThread(const ThreadInitCallback &cb,
                                  const std::string &name)
@@ -9,6 +10,8 @@ EventLoopThread::EventLoopThread(const ThreadInitCallback &cb,
     , mutex_()
     , cond_()
     , callback_(cb) // 传入的线程初始化回调函数，用户自定义的
+    , backend_(PollerBackend::kDefault)
+    , cpu_(-1)
 {
 }
 
@@ -47,9 +50,22 @@ EventLoop* EventLoopThread::startLoop()
     return loop;
 }
 
+bool EventLoopThread::running()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    return loop_ != nullptr;
+}
+
 void EventLoopThread::threadFunc()
 {
-    EventLoop loop;
+    // 先绑定 CPU 再创建 EventLoop：Poller 的事件数组、定时器等都在本线程首次访问，
+    // 内存会分配在该 CPU 所在的 NUMA 节点上
+    bool bound = cpu_ >= 0 && CpuAffinity::bindCurrentThread(cpu_);
+    EventLoop loop(backend_);
+    if (bound)
+    {
+        loop.setCpu(cpu_);
+    }
 
     // 用户自定义的函数
     if (callback_)
@@ -9,6 +9,7 @@
 
 // one loop per thread
 class EventLoop;
+enum class PollerBackend;
 class EventLoopThread : noncopyable
 {
 public:
@@ -18,7 +19,14 @@ public:
                     const std::string &name = std::string());
     ~EventLoopThread();
 
+    // 新线程的 EventLoop 使用的 IO 复用后端，需在 startLoop 之前设置
+    void setPollerBackend(PollerBackend backend) { backend_ = backend; }
+    // 新线程绑定的 CPU，-1 表示不绑定，需在 startLoop 之前设置
+    void setCpu(int cpu) { cpu_ = cpu; }
+
     EventLoop *startLoop(); // 开启线程池
+    // 线程中的 loop 是否还在（loop() 返回后 EventLoop 随线程函数一起销毁）
+    bool running();
 
 private:
     void threadFunc();
@@ -30,6 +38,8 @@ private:
     std::mutex mutex_;
     std::condition_variable cond_;
     ThreadInitCallback callback_;
+    PollerBackend backend_;
+    int cpu_;
 
 };
 
@@ -1,7 +1,30 @@
 #include <memory>
+#include <algorithm>
 
 #include "EventLoopThread.h"
 #include "EventLoopThreadPool.h"
+#include "EventLoop.h"
+#include "InetAddress.h"
+
+namespace
+{
+    // FNV-1a 加 murmur3 的 fmix32 收尾，短输入（4 字节 IP）的高位也能充分打散
+    uint32_t hashBytes(const void *data, size_t len, uint32_t hash = 2166136261u)
+    {
+        const unsigned char *p = static_cast<const unsigned char *>(data);
+        for (size_t i = 0; i < len; ++i)
+        {
+            hash ^= p[i];
+            hash *= 16777619u;
+        }
+        hash ^= hash >> 16;
+        hash *= 0x85ebca6bu;
+        hash ^= hash >> 13;
+        hash *= 0xc2b2ae35u;
+        hash ^= hash >> 16;
+        return hash;
+    }
+}
 
 EventLoopThreadPool::EventLoopThreadPool(EventLoop *baseLoop, const std::string &nameArg)
     : baseLoop_(baseLoop)
@@ -9,6 +32,9 @@ EventLoopThreadPool::EventLoopThreadPool(EventLoop *baseLoop, const std::string
     , started_(false)
     , numThreads_(0)
     , next_(0)
+    , backend_(PollerBackend::kDefault)
+    , policy_(kRoundRobin)
+    , randomState_(reinterpret_cast<uintptr_t>(this) | 1)
 {
 }
 
@@ -28,13 +54,22 @@ void EventLoopThreadPool::start(const ThreadInitCallback &cb)
         snprintf(buf, sizeof buf, "%s%d", name_.c_str(), i);
         // 创建EventLoopThread对象
         EventLoopThread *t = new EventLoopThread(cb, buf);
+        t->setPollerBackend(backend_);
+        t->setCpu(affinity_.cpuFor(i));
         // 加入此EventLoopThread入容器
         threads_.push_back(std::unique_ptr<EventLoopThread>(t));
         // 底层创建线程 绑定一个新的EventLoop 并返回该loop的地址
         // 此时已经开始执行新线程了
         loops_.push_back(t->startLoop());                           
+        if (loops_.back()->cpu() >= 0)
+        {
+            cpuLoops_.emplace(loops_.back()->cpu(), loops_.back());
+        }
     }
 
+    // 环很小，总是建好，start 之后再切换到 kConsistentHash 也能使用
+    buildHashRing();
+
     // 整个服务端只有一个线程运行baseLoop
     if(numThreads_ == 0 && cb)                                      
     {
@@ -66,6 +101,111 @@ EventLoop *EventLoopThreadPool::getNextLoop()
     return loop;
 }
 
+EventLoop *EventLoopThreadPool::getLoopForConnection(const InetAddress &peerAddr)
+{
+    if (loops_.empty())
+    {
+        return baseLoop_;
+    }
+    if (dispatchCallback_)
+    {
+        EventLoop *loop = dispatchCallback_(loops_, peerAddr);
+        return loop != nullptr ? loop : getNextLoop();
+    }
+    switch (policy_)
+    {
+    case kLeastConnections:
+        return leastConnectionsLoop();
+    case kPowerOfTwoChoices:
+        return powerOfTwoChoicesLoop();
+    case kConsistentHash:
+        return consistentHashLoop(peerAddr);
+    default:
+        return getNextLoop();
+    }
+}
+
+int64_t EventLoopThreadPool::loadOf(const EventLoop *loop)
+{
+    return loop->activeChannels() + loop->pendingFunctors() + loop->recentBusyMicroSeconds() / 100;
+}
+
+EventLoop *EventLoopThreadPool::leastConnectionsLoop() const
+{
+    EventLoop *best = loops_[0];
+    int bestCount = best->numConnections();
+    for (size_t i = 1; i < loops_.size(); ++i)
+    {
+        int count = loops_[i]->numConnections();
+        if (count < bestCount)
+        {
+            best = loops_[i];
+            bestCount = count;
+        }
+    }
+    return best;
+}
+
+EventLoop *EventLoopThreadPool::powerOfTwoChoicesLoop()
+{
+    if (loops_.size() == 1)
+    {
+        return loops_[0];
+    }
+    // xorshift64，只在 baseLoop 线程调用，不需要同步
+    randomState_ ^= randomState_ << 13;
+    randomState_ ^= randomState_ >> 7;
+    randomState_ ^= randomState_ << 17;
+    size_t n = loops_.size();
+    size_t a = randomState_ % n;
+    size_t b = (a + 1 + (randomState_ >> 32) % (n - 1)) % n; // 与 a 不同
+    EventLoop *first = loops_[a];
+    EventLoop *second = loops_[b];
+    int64_t firstLoad = loadOf(first);
+    int64_t secondLoad = loadOf(second);
+    if (firstLoad != secondLoad)
+    {
+        return firstLoad < secondLoad ? first : second;
+    }
+    // 瞬时负载相同时看长连接数
+    return first->numConnections() <= second->numConnections() ? first : second;
+}
+
+void EventLoopThreadPool::buildHashRing()
+{
+    hashRing_.clear();
+    hashRing_.reserve(loops_.size() * kVirtualNodes);
+    for (size_t i = 0; i < loops_.size(); ++i)
+    {
+        // 虚拟节点的位置只取决于线程下标，线程数变化时已有节点的位置不变
+        for (uint32_t replica = 0; replica < kVirtualNodes; ++replica)
+        {
+            uint32_t index = static_cast<uint32_t>(i);
+            uint32_t hash = hashBytes(&index, sizeof(index));
+            hash = hashBytes(&replica, sizeof(replica), hash);
+            hashRing_.emplace_back(hash, loops_[i]);
+        }
+    }
+    std::sort(hashRing_.begin(), hashRing_.end(),
+              [](const std::pair<uint32_t, EventLoop *> &a, const std::pair<uint32_t, EventLoop *> &b)
+              { return a.first < b.first; });
+}
+
+EventLoop *EventLoopThreadPool::consistentHashLoop(const InetAddress &peerAddr) const
+{
+    // 只哈希 IP，同一客户端的多条连接落在同一 loop
+    const in_addr &ip = peerAddr.getSockAddr()->sin_addr;
+    uint32_t hash = hashBytes(&ip, sizeof(ip));
+    auto it = std::lower_bound(hashRing_.begin(), hashRing_.end(), hash,
+                               [](const std::pair<uint32_t, EventLoop *> &node, uint32_t h)
+                               { return node.first < h; });
+    if (it == hashRing_.end())
+    {
+        it = hashRing_.begin();
+    }
+    return it->second;
+}
+
 std::vector<EventLoop *> EventLoopThreadPool::getAllLoops()
 {
     if(loops_.empty())
@@ -76,4 +216,16 @@ std::vector<EventLoop *> EventLoopThreadPool::getAllLoops()
     {
         return loops_;
     }
-}
\ No newline at end of file
+}
+
+bool EventLoopThreadPool::isLoopRunning(EventLoop *loop)
+{
+    for (size_t i = 0; i < loops_.size(); ++i)
+    {
+        if (loops_[i] == loop)
+        {
+            return threads_[i]->running();
+        }
+    }
+    return loop == baseLoop_ && baseLoop_->looping();
+}
@@ -5,38 +5,106 @@
 #include <vector>
 #include <memory>
 #include <functional>
+#include <unordered_map>
+#include <stdint.h>
+
+#include "CpuAffinity.h"
 
 class EventLoop;
 class EventLoopThread;
+class InetAddress;
+enum class PollerBackend;
 
 class EventLoopThreadPool
 {
 public:
     // 用户传入的函数
     using ThreadInitCallback = std::function<void(EventLoop*)>;
+    // 自定义分配策略：从 loops 中为来自 peerAddr 的新连接选一个
+    using DispatchCallback = std::function<EventLoop*(const std::vector<EventLoop*> &loops,
+                                                      const InetAddress &peerAddr)>;
+
+    /**
+     * 新连接的分配策略，见 getLoopForConnection
+     * kRoundRobin：轮询
+     * kLeastConnections：连接数最少的 loop
+     * kPowerOfTwoChoices：随机取两个，选 loadOf 较小的，开销固定且不会让所有连接涌向同一个 loop
+     * kConsistentHash：按对端 IP 一致性哈希，同一客户端总落在同一 loop，增减线程只迁移少量客户端
+     */
+    enum DispatchPolicy
+    {
+        kRoundRobin,
+        kLeastConnections,
+        kPowerOfTwoChoices,
+        kConsistentHash,
+    };
+
     EventLoopThreadPool(EventLoop *baseLoop, const std::string &nameArg);
     ~EventLoopThreadPool();
 
     // 设置线程数量
     void setThreadNum(int numThreads) { numThreads_ = numThreads; }
 
+    // subLoop 使用的 IO 复用后端
+    void setPollerBackend(PollerBackend backend) { backend_ = backend; }
+
+    // subLoop 线程的 CPU 绑定策略，第 i 个线程绑定 affinity.cpuFor(i)，需在 start 之前设置
+    void setCpuAffinity(const CpuAffinity &affinity) { affinity_ = affinity; }
+
+    // 分配策略，需在 start 之前设置；设置了 DispatchCallback 时优先使用它
+    void setDispatchPolicy(DispatchPolicy policy) { policy_ = policy; }
+    void setDispatchCallback(const DispatchCallback &cb) { dispatchCallback_ = cb; }
+
     // 启动线程池
     void start(const ThreadInitCallback &cb = ThreadInitCallback());
 
     // 如果工作在多线程中，baseLoop_(mainLoop)会默认以轮询的方式分配Channel给subLoop
     EventLoop *getNextLoop();
 
+    // 按分配策略为来自 peerAddr 的新连接选择 loop，只在 baseLoop 线程调用
+    EventLoop *getLoopForConnection(const InetAddress &peerAddr);
+
+    // kPowerOfTwoChoices 使用的负载：活跃 channel 数 + 待执行回调数 + 每 100us 平均耗时算 1
+    static int64_t loadOf(const EventLoop *loop);
+
     std::vector<EventLoop *> getAllLoops();
 
+    /**
+     * getAllLoops 中的 loop 是否还在运行，可跨线程调用
+     * baseLoop 由用户持有，不在运行时对象仍然有效；subLoop 不在运行时对象已经随线程销毁
+     */
+    bool isLoopRunning(EventLoop *loop);
+
+    // 绑定在 cpu 上的 subLoop，没有时返回 nullptr；用于按 SO_INCOMING_CPU 分配连接
+    EventLoop *getLoopForCpu(int cpu) const
+    {
+        auto it = cpuLoops_.find(cpu);
+        return it == cpuLoops_.end() ? nullptr : it->second;
+    }
+
     bool started() const { return started_; }
     const std::string name() const { return name_; }
 private:
+    static const int kVirtualNodes = 64;   // 一致性哈希中每个 loop 的虚拟节点数
+
+    void buildHashRing();
+    EventLoop *leastConnectionsLoop() const;
+    EventLoop *powerOfTwoChoicesLoop();
+    EventLoop *consistentHashLoop(const InetAddress &peerAddr) const;
+
     EventLoop *baseLoop_; // 用户使用muduo创建的loop 如果线程数为1 那直接使用用户创建的loop 否则创建多EventLoop
     std::string name_;
     bool started_;      // 开启线程池标志
     int numThreads_;    // 创建线程数量
     size_t next_;          // 轮询的下标
+    PollerBackend backend_; // subLoop 的 IO 复用后端
+    CpuAffinity affinity_;  // subLoop 线程的 CPU 绑定策略
     std::vector<std::unique_ptr<EventLoopThread>> threads_; // 保存所有的EventLoopThread容器
     std::vector<EventLoop *> loops_;    // 保存创建的所有EventLoop
+    std::unordered_map<int, EventLoop *> cpuLoops_; // CPU -> 绑定在其上的第一个 subLoop
+    DispatchPolicy policy_;
+    DispatchCallback dispatchCallback_;
+    std::vector<std::pair<uint32_t, EventLoop *>> hashRing_;  // 按哈希值排序的虚拟节点
+    uint64_t randomState_;  // kPowerOfTwoChoices 的 xorshift 状态
 };
 #endif // EVENT_LOOP_THREAD_POOL_H
\ No newline at end of file
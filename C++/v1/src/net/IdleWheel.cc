@@ -0,0 +1,107 @@
+#include "IdleWheel.h"
+#include "EventLoop.h"
+#include "TcpConnection.h"
+#include "WeakCallback.h"
+#include "Logging.h"
+
+IdleWheel::IdleWheel(EventLoop *loop, double timeoutSeconds, int buckets)
+    : loop_(loop)
+    , idleTicks_(buckets > 0 ? buckets : kDefaultBuckets)
+    , tickSeconds_(timeoutSeconds / idleTicks_)
+    , currentTick_(0)
+    , buckets_(idleTicks_ + 2, nullptr)
+{
+}
+
+IdleWheel::~IdleWheel()
+{
+    if (timerId_.valid())
+    {
+        loop_->cancel(timerId_);
+    }
+}
+
+void IdleWheel::start()
+{
+    // 轮子先于定时器销毁时回调自动失效
+    timerId_ = loop_->runEvery(tickSeconds_,
+                               makeWeakCallback(shared_from_this(), &IdleWheel::onTick));
+}
+
+void IdleWheel::add(Entry *entry, TcpConnection *conn)
+{
+    entry->conn = conn;
+    entry->lastActive = currentTick_;
+    link(entry, (currentTick_ + idleTicks_ + 1) % buckets_.size());
+}
+
+void IdleWheel::remove(Entry *entry)
+{
+    if (entry->bucket >= 0)
+    {
+        unlink(entry);
+    }
+}
+
+void IdleWheel::onTick()
+{
+    ++currentTick_;
+    const size_t bucket = currentTick_ % buckets_.size();
+    Entry *entry = buckets_[bucket];
+    buckets_[bucket] = nullptr;
+    while (entry)
+    {
+        Entry *next = entry->next;
+        uint64_t deadline = entry->lastActive + idleTicks_ + 1;
+        if (deadline <= currentTick_)
+        {
+            entry->prev = entry->next = nullptr;
+            entry->bucket = -1;
+            expired_.push_back(entry->conn->shared_from_this());
+        }
+        else
+        {
+            // 期间活跃过，按最后活跃的刻度重新挂入
+            link(entry, deadline % buckets_.size());
+        }
+        entry = next;
+    }
+
+    // 批量关闭，关闭过程中会回调 remove，所以放在遍历之后
+    for (const TcpConnectionPtr &conn : expired_)
+    {
+        LOG_INFO << "IdleWheel close idle connection " << conn->name().c_str();
+        conn->forceCloseInLoop();
+    }
+    expired_.clear();
+}
+
+void IdleWheel::link(Entry *entry, size_t bucket)
+{
+    entry->bucket = static_cast<int>(bucket);
+    entry->prev = nullptr;
+    entry->next = buckets_[bucket];
+    if (entry->next)
+    {
+        entry->next->prev = entry;
+    }
+    buckets_[bucket] = entry;
+}
+
+void IdleWheel::unlink(Entry *entry)
+{
+    if (entry->prev)
+    {
+        entry->prev->next = entry->next;
+    }
+    else
+    {
+        buckets_[entry->bucket] = entry->next;
+    }
+    if (entry->next)
+    {
+        entry->next->prev = entry->prev;
+    }
+    entry->prev = entry->next = nullptr;
+    entry->bucket = -1;
+}
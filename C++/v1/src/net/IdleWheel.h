@@ -0,0 +1,66 @@
+#ifndef IDLE_WHEEL_H
+#define IDLE_WHEEL_H
+
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+#include "noncopyable.h"
+#include "Callback.h"
+#include "TimerId.h"
+
+class EventLoop;
+
+/**
+ * 空闲连接回收用的分桶时间轮，每个 loop 一个，只在所属 loop 线程访问，不需要加锁
+ *
+ * 1. 超时时间分成 kDefaultBuckets 个刻度，整个轮子只有一个周期定时器，不为每个连接分配定时器
+ * 2. 连接有读写时 touch 只记录当前刻度（一次赋值），不移动链表节点；
+ *    桶到期时再检查，期间活跃过的连接按最后活跃的刻度挂到新的桶里
+ * 3. 同一个桶里超时的连接在一次定时器回调中批量关闭
+ *
+ * 连接实际被关闭的空闲时间在 [timeout, timeout + timeout / kDefaultBuckets) 之间
+ */
+class IdleWheel : noncopyable, public std::enable_shared_from_this<IdleWheel>
+{
+public:
+    // 嵌在 TcpConnection 中的链表节点
+    struct Entry
+    {
+        TcpConnection *conn = nullptr;
+        Entry *prev = nullptr;
+        Entry *next = nullptr;
+        uint64_t lastActive = 0;    // 最后一次活跃的刻度
+        int bucket = -1;            // 所在的桶，-1 表示不在轮子上
+    };
+
+    static const int kDefaultBuckets = 8;
+
+    IdleWheel(EventLoop *loop, double timeoutSeconds, int buckets = kDefaultBuckets);
+    ~IdleWheel();
+
+    // 注册周期定时器，可跨线程调用
+    void start();
+
+    // 以下只能在 loop 线程调用
+    void add(Entry *entry, TcpConnection *conn);
+    void remove(Entry *entry);
+    void touch(Entry *entry) { entry->lastActive = currentTick_; }
+
+    EventLoop* getLoop() const { return loop_; }
+
+private:
+    void onTick();
+    void link(Entry *entry, size_t bucket);
+    void unlink(Entry *entry);
+
+    EventLoop *loop_;
+    const int idleTicks_;           // 超时对应的刻度数
+    const double tickSeconds_;      // 一个刻度的时长
+    uint64_t currentTick_;
+    std::vector<Entry*> buckets_;   // idleTicks_ + 2 个桶，保证重新挂入的节点不会落回当前桶
+    TimerId timerId_;
+    std::vector<TcpConnectionPtr> expired_; // 本刻度超时的连接，复用避免分配
+};
+
+#endif // IDLE_WHEEL_H
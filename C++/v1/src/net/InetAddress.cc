@@ -9,6 +9,16 @@ InetAddress::InetAddress(uint16_t port, std::string ip)
     addr_.sin_addr.s_addr = htonl(INADDR_ANY); // FIXME : it should be addr.ip() and need some conversion
 }
 
+InetAddress InetAddress::fromIpPort(const std::string &ip, uint16_t port)
+{
+    sockaddr_in addr;
+    ::bzero(&addr, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = ::htons(port);
+    ::inet_pton(AF_INET, ip.c_str(), &addr.sin_addr);
+    return InetAddress(addr);
+}
+
 std::string InetAddress::toIp() const
 {
     char buf[64] = {0};
@@ -15,6 +15,9 @@ public:
     {
     }
 
+    // 按点分十进制的 ip 构造，主要给客户端使用（上面的构造函数总是绑定 INADDR_ANY）
+    static InetAddress fromIpPort(const std::string &ip, uint16_t port);
+
     std::string toIp() const;
     std::string toIpPort() const;
     uint16_t toPort() const;
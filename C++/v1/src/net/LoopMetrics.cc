@@ -0,0 +1,153 @@
+#include "LoopMetrics.h"
+#include "EventLoop.h"
+
+#include <stdio.h>
+
+Histogram::Histogram()
+    : sum_(0)
+{
+    for (int i = 0; i < kBuckets; ++i)
+    {
+        buckets_[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+void Histogram::snapshot(Snapshot *snap) const
+{
+    snap->count = 0;
+    for (int i = 0; i < kBuckets; ++i)
+    {
+        snap->buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+        snap->count += snap->buckets[i];
+    }
+    snap->sum = sum_.load(std::memory_order_relaxed);
+}
+
+void MetricsWriter::family(const char *name, const char *type, const char *help)
+{
+    out_->append("# HELP ").append(name).append(" ").append(help).append("\n");
+    out_->append("# TYPE ").append(name).append(" ").append(type).append("\n");
+}
+
+void MetricsWriter::appendLabels(const std::string &labels, const char *extra)
+{
+    if (labels.empty() && extra == nullptr)
+    {
+        return;
+    }
+    out_->push_back('{');
+    out_->append(labels);
+    if (extra)
+    {
+        if (!labels.empty())
+        {
+            out_->push_back(',');
+        }
+        out_->append(extra);
+    }
+    out_->push_back('}');
+}
+
+void MetricsWriter::sample(const char *name, const std::string &labels, int64_t value)
+{
+    out_->append(name);
+    appendLabels(labels, nullptr);
+    char buf[32];
+    snprintf(buf, sizeof buf, " %lld\n", static_cast<long long>(value));
+    out_->append(buf);
+}
+
+void MetricsWriter::histogram(const char *name, const std::string &labels, const Histogram::Snapshot &snap)
+{
+    std::string bucketName = std::string(name) + "_bucket";
+    char le[32];
+    int64_t cumulative = 0;
+    for (int i = 0; i < Histogram::kBuckets; ++i)
+    {
+        cumulative += snap.buckets[i];
+        int64_t bound = Histogram::upperBound(i);
+        if (bound < 0)
+        {
+            snprintf(le, sizeof le, "le=\"+Inf\"");
+        }
+        else
+        {
+            snprintf(le, sizeof le, "le=\"%lld\"", static_cast<long long>(bound));
+        }
+        out_->append(bucketName);
+        appendLabels(labels, le);
+        snprintf(le, sizeof le, " %lld\n", static_cast<long long>(cumulative));
+        out_->append(le);
+    }
+    sample((std::string(name) + "_sum").c_str(), labels, snap.sum);
+    sample((std::string(name) + "_count").c_str(), labels, cumulative);
+}
+
+std::string MetricsWriter::label(const char *key, const std::string &value)
+{
+    std::string result(key);
+    result.append("=\"");
+    for (char c : value)
+    {
+        if (c == '\\' || c == '"')
+        {
+            result.push_back('\\');
+            result.push_back(c);
+        }
+        else if (c == '\n')
+        {
+            result.append("\\n");
+        }
+        else
+        {
+            result.push_back(c);
+        }
+    }
+    result.push_back('"');
+    return result;
+}
+
+namespace
+{
+    std::string loopLabel(size_t index)
+    {
+        return MetricsWriter::label("loop", std::to_string(index));
+    }
+
+    void writeHistograms(MetricsWriter *writer, const std::vector<EventLoop *> &loops,
+                         const char *name, const char *help, Histogram LoopMetrics::*member)
+    {
+        writer->family(name, "histogram", help);
+        Histogram::Snapshot snap;
+        for (size_t i = 0; i < loops.size(); ++i)
+        {
+            (loops[i]->metrics().*member).snapshot(&snap);
+            writer->histogram(name, loopLabel(i), snap);
+        }
+    }
+}
+
+void LoopMetrics::write(MetricsWriter *writer, const std::vector<EventLoop *> &loops)
+{
+    writeHistograms(writer, loops, "eventloop_poll_wait_microseconds",
+                    "Time blocked in poll per iteration.", &LoopMetrics::pollWaitMicroSeconds);
+    writeHistograms(writer, loops, "eventloop_events_per_poll",
+                    "Active channels returned by each poll.", &LoopMetrics::eventsPerPoll);
+    writeHistograms(writer, loops, "eventloop_handle_event_microseconds",
+                    "Time spent in each Channel::handleEvent.", &LoopMetrics::handleEventMicroSeconds);
+    writeHistograms(writer, loops, "eventloop_functor_batch_size",
+                    "Queued functors run per non-empty batch.", &LoopMetrics::functorBatch);
+    writeHistograms(writer, loops, "eventloop_timer_lag_microseconds",
+                    "Timer run time minus scheduled expiration.", &LoopMetrics::timerLagMicroSeconds);
+
+    writer->family("eventloop_connections", "gauge", "Connections assigned to the loop.");
+    for (size_t i = 0; i < loops.size(); ++i)
+    {
+        writer->sample("eventloop_connections", loopLabel(i), loops[i]->numConnections());
+    }
+    writer->family("eventloop_pending_functors", "gauge", "Queued functors not yet run.");
+    for (size_t i = 0; i < loops.size(); ++i)
+    {
+        writer->sample("eventloop_pending_functors", loopLabel(i), loops[i]->pendingFunctors());
+    }
+}
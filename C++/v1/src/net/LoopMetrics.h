@@ -0,0 +1,112 @@
+#ifndef LOOP_METRICS_H
+#define LOOP_METRICS_H
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "noncopyable.h"
+
+class EventLoop;
+
+/**
+ * 以 2 的幂为桶边界的直方图：第 i 个桶统计 (2^(i-1), 2^i] 的值，最后一个桶是 +Inf
+ * 只由一个线程（所属 loop 线程）写，计数用 relaxed 的 load + store，不需要原子加；
+ * 其它线程随时可以读取快照，只保证近似一致
+ */
+class Histogram : noncopyable
+{
+public:
+    static const int kBuckets = 26;     // 最大的有限边界为 2^24，微秒约 16.8 秒
+
+    struct Snapshot
+    {
+        int64_t buckets[kBuckets];      // 各桶的计数（非累积）
+        int64_t count;
+        int64_t sum;
+    };
+
+    Histogram();
+
+    void record(int64_t value)
+    {
+        int i = bucketOf(value);
+        buckets_[i].store(buckets_[i].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        sum_.store(sum_.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    void snapshot(Snapshot *snap) const;
+
+    // 第 i 个桶的上界，最后一个桶返回 -1 表示 +Inf
+    static int64_t upperBound(int i) { return i + 1 < kBuckets ? (int64_t(1) << i) : -1; }
+
+private:
+    static int bucketOf(int64_t value)
+    {
+        if (value <= 1)
+        {
+            return 0;
+        }
+        int i = 64 - __builtin_clzll(static_cast<uint64_t>(value - 1));
+        return i < kBuckets - 1 ? i : kBuckets - 1;
+    }
+
+    std::atomic<int64_t> buckets_[kBuckets];
+    std::atomic<int64_t> sum_;
+};
+
+/**
+ * 按 Prometheus 文本格式输出指标
+ * 同一个指标族的样本必须连续写出：先调用 family 声明类型和说明，再写该族所有样本
+ */
+class MetricsWriter : noncopyable
+{
+public:
+    explicit MetricsWriter(std::string *out) : out_(out) {}
+
+    // type 为 counter / gauge / histogram
+    void family(const char *name, const char *type, const char *help);
+    // labels 形如 loop="0"，可以为空
+    void sample(const char *name, const std::string &labels, int64_t value);
+    void histogram(const char *name, const std::string &labels, const Histogram::Snapshot &snap);
+
+    // 转义 label 值中的 \ " 和换行
+    static std::string label(const char *key, const std::string &value);
+
+private:
+    void appendLabels(const std::string &labels, const char *extra);
+
+    std::string *out_;
+};
+
+/**
+ * EventLoop 的运行时统计，EventLoop::setMetricsEnabled 打开后由 loop 线程记录
+ * 各直方图的单位见成员名，均只由 loop 线程写
+ */
+struct LoopMetrics : noncopyable
+{
+    Histogram pollWaitMicroSeconds;     // 阻塞在 poll 中的时间
+    Histogram eventsPerPoll;            // 每次 poll 返回的活跃 channel 数
+    Histogram handleEventMicroSeconds;  // 每个 Channel::handleEvent 的耗时
+    Histogram functorBatch;             // 每轮执行的跨线程回调数（只统计非空的轮次）
+    Histogram timerLagMicroSeconds;     // 定时器实际执行时刻减去应到期时刻
+
+    // 输出一组 loop 的统计，以 loop 在 loops 中的下标作为 loop 标签
+    static void write(MetricsWriter *writer, const std::vector<EventLoop *> &loops);
+};
+
+/**
+ * 一个 TcpServer 在一个 IO 线程上的收发字节数，只由该线程写
+ * 连接持有 shared_ptr，TcpServer 先析构也不会悬空
+ */
+struct TrafficCounters : noncopyable
+{
+    std::atomic<int64_t> bytesIn{0};
+    std::atomic<int64_t> bytesOut{0};
+
+    void addIn(int64_t n) { bytesIn.store(bytesIn.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+    void addOut(int64_t n) { bytesOut.store(bytesOut.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+};
+
+#endif // LOOP_METRICS_H
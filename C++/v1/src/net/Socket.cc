@@ -4,6 +4,7 @@
 #include <string.h>
 #include <netinet/tcp.h>
 #include <sys/socket.h>
+#include <linux/filter.h>
 
 #include "Socket.h"
 #include "Logging.h"
@@ -48,9 +49,10 @@ int Socket::accept(InetAddress *peeraddr)
     {
         peeraddr->setSockAddr(addr);
     }
-    else
+    else if (errno != EAGAIN && errno != EWOULDBLOCK)
     {
-        LOG_ERROR << "accept4() failed";
+        // EAGAIN 说明连接已经取完，批量 accept 每次都会遇到，不算错误
+        LOG_ERROR << "accept4() failed:" << errno;
     }
     return connfd;
 }
@@ -74,6 +76,21 @@ void Socket::setTcpNoDelay(bool on)
     ::setsockopt(sockfd_, IPPROTO_TCP, TCP_NODELAY, &optval, sizeof(optval)); // TCP_NODELAY包含头文件 <netinet/tcp.h>
 }
 
+void Socket::setTcpCork(bool on)
+{
+    int optval = on ? 1 : 0;
+    ::setsockopt(sockfd_, IPPROTO_TCP, TCP_CORK, &optval, sizeof(optval));
+}
+
+void Socket::setBusyPoll(int usec)
+{
+    // 超过 net.core.busy_read 的值需要 CAP_NET_ADMIN
+    if (::setsockopt(sockfd_, SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(usec)) < 0)
+    {
+        LOG_WARN << "setsockopt SO_BUSY_POLL failed:" << errno;
+    }
+}
+
 // 设置地址复用，其实就是可以使用处于Time-wait的端口
 void Socket::setReuseAddr(bool on)
 {
@@ -88,6 +105,38 @@ void Socket::setReusePort(bool on)
     ::setsockopt(sockfd_, SOL_SOCKET, SO_REUSEPORT, &optval, sizeof(optval)); // TCP_NODELAY包含头文件 <netinet/tcp.h>
 }
 
+bool Socket::attachReusePortCpuSteering(const std::vector<int> &cpuOfIndex)
+{
+#ifdef SO_ATTACH_REUSEPORT_CBPF
+    // A = 当前 CPU；逐个比较，命中返回下标；都不命中返回 A % n
+    std::vector<sock_filter> code;
+    code.push_back(BPF_STMT(BPF_LD | BPF_W | BPF_ABS, static_cast<uint32_t>(SKF_AD_OFF + SKF_AD_CPU)));
+    for (size_t i = 0; i < cpuOfIndex.size(); ++i)
+    {
+        if (cpuOfIndex[i] >= 0)
+        {
+            code.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, static_cast<uint32_t>(cpuOfIndex[i]), 0, 1));
+            code.push_back(BPF_STMT(BPF_RET | BPF_K, static_cast<uint32_t>(i)));
+        }
+    }
+    code.push_back(BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, static_cast<uint32_t>(cpuOfIndex.size())));
+    code.push_back(BPF_STMT(BPF_RET | BPF_A, 0));
+
+    sock_fprog prog;
+    prog.len = static_cast<unsigned short>(code.size());
+    prog.filter = code.data();
+    if (::setsockopt(sockfd_, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) < 0)
+    {
+        LOG_WARN << "setsockopt SO_ATTACH_REUSEPORT_CBPF failed:" << errno;
+        return false;
+    }
+    return true;
+#else
+    (void)cpuOfIndex;
+    return false;
+#endif
+}
+
 void Socket::setKeepAlive(bool on)
 {
     int optval = on ? 1 : 0;
@@ -2,6 +2,8 @@
 
 #include "noncopyable.h"
 
+#include <vector>
+
 class InetAddress;
 
 // 封装socket fd
@@ -30,6 +32,15 @@ public:
     void setReuseAddr(bool on);     // 设置地址复用
     void setReusePort(bool on);     // 设置端口复用
     void setKeepAlive(bool on);     // 设置长连接
+    void setTcpCork(bool on);       // 塞住/拔开 TCP 输出，拔开时把攒下的数据按满段发出
+    void setBusyPoll(int usec);     // SO_BUSY_POLL：阻塞读时在驱动队列上忙等 usec 微秒
+
+    /**
+     * 给本套接字所在的 SO_REUSEPORT 组挂一个 CBPF 程序：
+     * 收到 SYN 的 CPU 等于 cpuOfIndex[i] 时选组内第 i 个套接字（按 listen 的顺序），
+     * 其他 CPU 取模分配；cpuOfIndex 中为 -1 的项不参与匹配
+     */
+    bool attachReusePortCpuSteering(const std::vector<int> &cpuOfIndex);
 
 private:
     const int sockfd_;
@@ -0,0 +1,195 @@
+#include "StallWatchdog.h"
+#include "EventLoop.h"
+#include "LoopClock.h"
+#include "Logging.h"
+
+#include <execinfo.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <chrono>
+
+namespace
+{
+    // 信号处理函数与看门狗线程之间的交接区，同一时刻只有一次采样
+    void *s_frames[StallWatchdog::kMaxFrames];
+    std::atomic<pid_t> s_sampleTid(0);      // 需要采样的线程
+    std::atomic<int> s_sampleDepth(-1);     // 处理函数写完后置为帧数
+
+    void sampleHandler(int)
+    {
+        int savedErrno = errno;
+        // 只采样目标线程，迟到的信号（采样已经超时放弃）直接忽略
+        if (static_cast<pid_t>(::syscall(SYS_gettid)) == s_sampleTid.load(std::memory_order_acquire))
+        {
+            int depth = ::backtrace(s_frames, StallWatchdog::kMaxFrames);
+            s_sampleDepth.store(depth, std::memory_order_release);
+        }
+        errno = savedErrno;
+    }
+}
+
+StallWatchdog::StallWatchdog(double thresholdSeconds)
+    : thresholdUs_(static_cast<int64_t>(thresholdSeconds * Timestamp::kMicroSecondsPerSecond))
+    , checkIntervalSeconds_(thresholdSeconds / 2)
+    , sampleSignal_(SIGUSR2)
+    , stalls_(0)
+    , running_(false)
+    , thread_(std::bind(&StallWatchdog::threadFunc, this), "StallWatchdog")
+{
+}
+
+StallWatchdog::~StallWatchdog()
+{
+    stop();
+}
+
+void StallWatchdog::watch(EventLoop *loop, const std::string &name)
+{
+    loops_.push_back(Watched{loop, name, 0});
+}
+
+void StallWatchdog::watch(const std::vector<EventLoop *> &loops, const std::string &namePrefix)
+{
+    for (size_t i = 0; i < loops.size(); ++i)
+    {
+        watch(loops[i], namePrefix + std::to_string(i));
+    }
+}
+
+void StallWatchdog::start()
+{
+    if (sampleSignal_ > 0)
+    {
+        // backtrace 第一次调用时会加载 libgcc，可能分配内存，先在这里调用一次，信号处理函数中才安全
+        void *warmup[1];
+        ::backtrace(warmup, 1);
+
+        struct sigaction sa;
+        ::memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = sampleHandler;
+        sa.sa_flags = SA_RESTART;
+        sigemptyset(&sa.sa_mask);
+        if (::sigaction(sampleSignal_, &sa, nullptr) < 0)
+        {
+            LOG_ERROR << "StallWatchdog::start sigaction failed, stack sampling disabled";
+            sampleSignal_ = 0;
+        }
+    }
+    running_ = true;
+    thread_.start();
+}
+
+void StallWatchdog::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_)
+        {
+            return;
+        }
+        running_ = false;
+    }
+    cond_.notify_one();
+    thread_.join();
+}
+
+void StallWatchdog::threadFunc()
+{
+    const auto interval = std::chrono::microseconds(
+        static_cast<int64_t>(checkIntervalSeconds_ * Timestamp::kMicroSecondsPerSecond));
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (running_)
+    {
+        cond_.wait_for(lock, interval);
+        if (!running_)
+        {
+            break;
+        }
+        int64_t now = LoopClock::monotonicMicroSeconds();
+        for (Watched &watched : loops_)
+        {
+            check(&watched, now);
+        }
+    }
+}
+
+void StallWatchdog::check(Watched *watched, int64_t now)
+{
+    EventLoop *loop = watched->loop;
+    uint64_t seq = loop->iterationSeq();
+    int64_t busySince = loop->busySince();
+    // 序号变了说明读到的 busySince 可能属于别的轮次
+    if (busySince == 0 || seq != loop->iterationSeq() || seq == watched->reportedSeq)
+    {
+        return;
+    }
+    int64_t stalledUs = now - busySince;
+    if (stalledUs >= thresholdUs_)
+    {
+        watched->reportedSeq = seq;
+        stalls_.fetch_add(1, std::memory_order_relaxed);
+        report(*watched, seq, stalledUs);
+    }
+}
+
+void StallWatchdog::report(const Watched &watched, uint64_t seq, int64_t stalledUs)
+{
+    EventLoop *loop = watched.loop;
+    EventLoop::Activity activity = loop->currentActivity();
+    int fd = loop->currentFd();
+
+    void *frames[kMaxFrames];
+    int depth = sampleSignal_ > 0 ? sampleStack(loop->threadId(), frames) : 0;
+    // 采样期间 loop 可能已经恢复，调用栈就不一定是卡住时的了
+    bool recovered = loop->iterationSeq() != seq;
+
+    LOG_WARN << "StallWatchdog - loop " << watched.name.c_str() << " (tid " << loop->threadId()
+             << ") stalled for " << static_cast<int>(stalledUs / 1000) << " ms in "
+             << EventLoop::activityName(activity) << ", fd " << fd
+             << (recovered ? ", recovered before stack sample" : "");
+    if (depth > 0)
+    {
+        char **symbols = ::backtrace_symbols(frames, depth);
+        if (symbols)
+        {
+            // 跳过信号处理函数和信号跳板两帧
+            for (int i = 2; i < depth; ++i)
+            {
+                LOG_WARN << "StallWatchdog -   #" << i - 2 << " " << symbols[i];
+            }
+            ::free(symbols);
+        }
+    }
+}
+
+int StallWatchdog::sampleStack(pid_t tid, void **frames)
+{
+    s_sampleDepth.store(-1, std::memory_order_relaxed);
+    s_sampleTid.store(tid, std::memory_order_release);
+    if (::syscall(SYS_tgkill, ::getpid(), tid, sampleSignal_) < 0)
+    {
+        s_sampleTid.store(0, std::memory_order_relaxed);
+        return 0;
+    }
+    // 最多等 100ms，loop 线程可能屏蔽了信号
+    int depth = -1;
+    for (int i = 0; i < 100; ++i)
+    {
+        depth = s_sampleDepth.load(std::memory_order_acquire);
+        if (depth >= 0)
+        {
+            break;
+        }
+        ::usleep(1000);
+    }
+    s_sampleTid.store(0, std::memory_order_release);
+    if (depth <= 0)
+    {
+        return 0;
+    }
+    ::memcpy(frames, s_frames, sizeof(void *) * depth);
+    return depth;
+}
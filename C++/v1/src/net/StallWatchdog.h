@@ -0,0 +1,78 @@
+#ifndef STALL_WATCHDOG_H
+#define STALL_WATCHDOG_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "noncopyable.h"
+#include "Thread.h"
+
+class EventLoop;
+
+/**
+ * 事件循环卡顿检测
+ *
+ * 一个慢回调（例如在 IO 线程里同步查询数据库）会让同一个 loop 上的所有连接停止响应。
+ * 看门狗线程定期读取各 loop 的心跳（见 EventLoop::iterationSeq），
+ * 一轮处理超过阈值时记录：哪个 loop、正在处理的 fd、回调类型，以及 loop 线程当前的调用栈
+ *
+ * 1. 每个卡住的轮次只报告一次，报告写入日志（Logger 输出到 AsyncLogging 时即为异步日志）
+ * 2. 调用栈由发给 loop 线程的信号采样：信号处理函数里 backtrace，看门狗线程再解析符号；
+ *    信号会打断 loop 线程正在进行的阻塞系统调用（处理函数带 SA_RESTART，多数调用会自动重启），
+ *    不需要时用 setStackSampling(0) 关闭
+ * 3. 被监视的 EventLoop 需比看门狗活得久，退出时先 stop
+ */
+class StallWatchdog : noncopyable
+{
+public:
+    static const int kMaxFrames = 64;
+
+    explicit StallWatchdog(double thresholdSeconds = 0.1);
+    ~StallWatchdog();
+
+    // 以下需在 start 之前调用
+    void watch(EventLoop *loop, const std::string &name);
+    void watch(const std::vector<EventLoop *> &loops, const std::string &namePrefix);
+    // 采样调用栈使用的信号，默认 SIGUSR2，0 表示不采样；整个进程只能有一个看门狗采样
+    void setStackSampling(int signo) { sampleSignal_ = signo; }
+    // 检查间隔，默认为阈值的一半
+    void setCheckInterval(double seconds) { checkIntervalSeconds_ = seconds; }
+
+    void start();
+    void stop();
+
+    // 已报告的卡顿次数
+    int64_t stalls() const { return stalls_.load(std::memory_order_relaxed); }
+
+private:
+    struct Watched
+    {
+        EventLoop *loop;
+        std::string name;
+        uint64_t reportedSeq;   // 已报告过的轮次，同一轮不重复报告
+    };
+
+    void threadFunc();
+    void check(Watched *watched, int64_t now);
+    void report(const Watched &watched, uint64_t seq, int64_t stalledUs);
+    // 向 tid 发送采样信号并等待处理函数写完调用栈，返回帧数，失败返回 0
+    int sampleStack(pid_t tid, void **frames);
+
+    const int64_t thresholdUs_;
+    double checkIntervalSeconds_;
+    int sampleSignal_;
+    std::vector<Watched> loops_;
+    std::atomic<int64_t> stalls_;
+
+    bool running_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    Thread thread_;
+};
+
+#endif // STALL_WATCHDOG_H
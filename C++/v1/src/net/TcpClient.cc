@@ -0,0 +1,166 @@
+#include "TcpClient.h"
+#include "Connector.h"
+#include "EventLoop.h"
+#include "Logging.h"
+
+#include <string.h>
+#include <sys/socket.h>
+
+namespace
+{
+    // TcpClient 析构后连接仍可能存活，其关闭回调不能再访问 TcpClient
+    void removeConnectionDetached(EventLoop *loop, const TcpConnectionPtr &conn)
+    {
+        loop->addConnections(-1);
+        loop->queueInLoop(std::bind(&TcpConnection::connectDestroyed, conn));
+    }
+
+    void defaultConnectionCallback(const TcpConnectionPtr &conn)
+    {
+        LOG_INFO << conn->localAddress().toIpPort() << " -> " << conn->peerAddress().toIpPort()
+                 << " is " << (conn->connected() ? "UP" : "DOWN");
+    }
+
+    void defaultMessageCallback(const TcpConnectionPtr &, Buffer *buf, Timestamp)
+    {
+        buf->retrieveAll();
+    }
+}
+
+TcpClient::TcpClient(EventLoop *loop,
+                     const InetAddress &serverAddr,
+                     const std::string &nameArg)
+    : loop_(loop)
+    , connector_(new Connector(loop, serverAddr))
+    , name_(nameArg)
+    , connectionCallback_(defaultConnectionCallback)
+    , messageCallback_(defaultMessageCallback)
+    , retry_(false)
+    , connect_(false)
+    , nextConnId_(1)
+{
+    connector_->setNewConnectionCallback(
+        std::bind(&TcpClient::newConnection, this, std::placeholders::_1));
+    LOG_INFO << "TcpClient::TcpClient[" << name_.c_str() << "] - connector " << connector_.get();
+}
+
+TcpClient::~TcpClient()
+{
+    LOG_INFO << "TcpClient::~TcpClient[" << name_.c_str() << "] - connector " << connector_.get();
+    TcpConnectionPtr conn;
+    bool unique = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        unique = connection_.use_count() == 1;
+        conn = connection_;
+    }
+    if (conn)
+    {
+        // 连接的关闭回调指向本对象，换成不依赖 TcpClient 的版本
+        CloseCallback cb = std::bind(&removeConnectionDetached, loop_, std::placeholders::_1);
+        loop_->runInLoop(std::bind(&TcpConnection::setCloseCallback, conn, cb));
+        if (unique)
+        {
+            conn->forceClose();
+        }
+    }
+    else
+    {
+        connector_->stop();
+    }
+}
+
+void TcpClient::connect()
+{
+    LOG_INFO << "TcpClient::connect[" << name_.c_str() << "] - connecting to "
+             << connector_->serverAddress().toIpPort().c_str();
+    connect_ = true;
+    connector_->start();
+}
+
+void TcpClient::disconnect()
+{
+    connect_ = false;
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (connection_)
+    {
+        connection_->shutdown();
+    }
+}
+
+void TcpClient::stop()
+{
+    connect_ = false;
+    connector_->stop();
+}
+
+void TcpClient::setConnectTimeout(double seconds)
+{
+    connector_->setConnectTimeout(seconds);
+}
+
+void TcpClient::setRetryDelay(double initialSeconds, double maxSeconds)
+{
+    connector_->setRetryDelay(initialSeconds, maxSeconds);
+}
+
+void TcpClient::setConnectFailedCallback(std::function<void()> cb)
+{
+    connector_->setConnectFailedCallback(cb);
+}
+
+void TcpClient::newConnection(int sockfd)
+{
+    sockaddr_in local;
+    sockaddr_in peer;
+    ::memset(&local, 0, sizeof(local));
+    ::memset(&peer, 0, sizeof(peer));
+    socklen_t addrlen = sizeof(local);
+    ::getsockname(sockfd, (sockaddr *)&local, &addrlen);
+    addrlen = sizeof(peer);
+    ::getpeername(sockfd, (sockaddr *)&peer, &addrlen);
+    InetAddress localAddr(local);
+    InetAddress peerAddr(peer);
+
+    char buf[64] = {0};
+    snprintf(buf, sizeof buf, ":%s#%d", peerAddr.toIpPort().c_str(), nextConnId_);
+    ++nextConnId_;
+    std::string connName = name_ + buf;
+
+    TcpConnectionPtr conn = std::make_shared<TcpConnection>(loop_, connName, sockfd, localAddr, peerAddr);
+    conn->setConnectionCallback(connectionCallback_);
+    conn->setMessageCallback(messageCallback_);
+    conn->setWriteCompleteCallback(writeCompleteCallback_);
+    conn->setCloseCallback(
+        std::bind(&TcpClient::removeConnection, this, std::placeholders::_1));
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        connection_ = conn;
+    }
+    loop_->addConnections(1);
+    conn->connectEstablished();
+}
+
+void TcpClient::removeConnection(const TcpConnectionPtr &conn)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (connection_ == conn)
+        {
+            connection_.reset();
+        }
+    }
+    loop_->addConnections(-1);
+    loop_->queueInLoop(std::bind(&TcpConnection::connectDestroyed, conn));
+    if (retry_ && connect_)
+    {
+        LOG_INFO << "TcpClient::connect[" << name_.c_str() << "] - Reconnecting to "
+                 << connector_->serverAddress().toIpPort().c_str();
+        connector_->restart();
+    }
+    else
+    {
+        // 不重连时也要让 Connector 回到未连接状态，否则之后的 connect 什么都不做
+        connector_->connectionClosed();
+    }
+}
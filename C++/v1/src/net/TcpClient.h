@@ -0,0 +1,82 @@
+#ifndef TCP_CLIENT_H
+#define TCP_CLIENT_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "noncopyable.h"
+#include "Callback.h"
+#include "TcpConnection.h"
+
+class Connector;
+class EventLoop;
+using ConnectorPtr = std::shared_ptr<Connector>;
+
+/**
+ * 主动发起连接的一端，连接建立后和服务端一样使用 TcpConnection 收发数据
+ *
+ * 1. 连接由 Connector 非阻塞地建立，支持连接超时和指数退避重试
+ * 2. enableRetry 之后连接断开会自动重连
+ * 3. 析构时还持有的连接会被强制关闭；正在连接时应在 loop 线程中析构
+ */
+class TcpClient : noncopyable
+{
+public:
+    TcpClient(EventLoop *loop,
+              const InetAddress &serverAddr,
+              const std::string &nameArg);
+    ~TcpClient();
+
+    void connect();
+    // 半关闭当前连接
+    void disconnect();
+    // 停止连接（包括等待中的重试）
+    void stop();
+
+    TcpConnectionPtr connection() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return connection_;
+    }
+
+    EventLoop* getLoop() const { return loop_; }
+    const std::string& name() const { return name_; }
+    bool retry() const { return retry_; }
+    // 连接断开后自动重连
+    void enableRetry() { retry_ = true; }
+
+    // 以下需在 connect 之前设置
+    // 连接超时，默认 Connector::kDefaultConnectTimeout，0 表示不限制
+    void setConnectTimeout(double seconds);
+    void setRetryDelay(double initialSeconds, double maxSeconds);
+    // 每次连接失败时在 loop 线程调用，之后按退避间隔重试，回调中调用 stop 可以放弃
+    void setConnectFailedCallback(std::function<void()> cb);
+
+    void setConnectionCallback(ConnectionCallback cb)
+    { connectionCallback_ = std::move(cb); }
+    void setMessageCallback(MessageCallback cb)
+    { messageCallback_ = std::move(cb); }
+    void setWriteCompleteCallback(WriteCompleteCallback cb)
+    { writeCompleteCallback_ = std::move(cb); }
+
+private:
+    // 以下在 loop 线程中调用
+    void newConnection(int sockfd);
+    void removeConnection(const TcpConnectionPtr &conn);
+
+    EventLoop *loop_;
+    ConnectorPtr connector_;
+    const std::string name_;
+    ConnectionCallback connectionCallback_;
+    MessageCallback messageCallback_;
+    WriteCompleteCallback writeCompleteCallback_;
+    bool retry_;
+    std::atomic_bool connect_;  // connect / disconnect 可跨线程调用
+    int nextConnId_;
+    mutable std::mutex mutex_;
+    TcpConnectionPtr connection_;   // 由 mutex_ 保护
+};
+
+#endif // TCP_CLIENT_H
@@ -4,7 +4,10 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <string.h>
+#include <unistd.h>
 #include <netinet/tcp.h>
+#include <sys/sendfile.h>
+#include <limits.h>
 
 #include "TcpConnection.h"
 #include "Logging.h"
@@ -29,33 +32,109 @@ TcpConnection::TcpConnection(EventLoop *loop,
                              int sockfd,
                              const InetAddress &localAddr,
                              const InetAddress &peerAddr)
+    : TcpConnection(loop, nameArg, sockfd, localAddr, true, peerAddr, true)
+{
+}
+
+TcpConnection::TcpConnection(EventLoop *loop,
+                             int sockfd,
+                             const InetAddress &peerAddr,
+                             bool logLifecycle)
+    : TcpConnection(loop, std::string(), sockfd, InetAddress(), false, peerAddr, logLifecycle)
+{
+}
+
+TcpConnection::TcpConnection(EventLoop *loop,
+                             const std::string &nameArg,
+                             int sockfd,
+                             const InetAddress &localAddr,
+                             bool localAddrKnown,
+                             const InetAddress &peerAddr,
+                             bool logLifecycle)
     : loop_(CheckLoopNotNull(loop))
     , name_(nameArg)
+    , id_(0)
     , state_(kConnecting)
     , reading_(true)
-    , socket_(new Socket(sockfd))
-    , channel_(new Channel(loop, sockfd))
+    , readPaused_(false)
+    , socket_(sockfd)
+    , channel_(loop, sockfd)
     , localAddr_(localAddr)
+    , localAddrKnown_(localAddrKnown)
+    , logLifecycle_(logLifecycle)
     , peerAddr_(peerAddr)
     , highWaterMark_(64 * 1024 * 1024) // 64M 避免发送太快对方接受太慢
+    , lowWaterMark_(0)
+    , flowControl_(false)
+    , coalescing_(false)
+    , corkOnFlush_(false)
+    , flushScheduled_(false)
+    , pendingFileBytes_(0)
+    , drainBudgetBytes_(kDefaultDrainBytes)
+    , drainBudgetIterations_(kDefaultDrainIterations)
 {
     // 下面给channel设置相应的回调函数 poller给channel通知感兴趣的事件发生了 channel会回调相应的回调函数
-    channel_->setReadCallback(
+    channel_.setReadCallback(
         std::bind(&TcpConnection::handleRead, this, std::placeholders::_1));
-    channel_->setWriteCallback(
+    channel_.setWriteCallback(
         std::bind(&TcpConnection::handleWrite, this));
-    channel_->setCloseCallback(
+    channel_.setCloseCallback(
         std::bind(&TcpConnection::handleClose, this));
-    channel_->setErrorCallback(
+    channel_.setErrorCallback(
         std::bind(&TcpConnection::handleError, this));
 
-    LOG_INFO << "TcpConnection::ctor[" << name_.c_str() << "] at fd =" << sockfd;
-    socket_->setKeepAlive(true);
+    if (logLifecycle_)
+    {
+        LOG_INFO << "TcpConnection::ctor[" << name().c_str() << "] at fd =" << sockfd;
+    }
+    socket_.setKeepAlive(true);
+}
+
+const InetAddress& TcpConnection::localAddress() const
+{
+    if (!localAddrKnown_)
+    {
+        // 通过sockfd获取其绑定的本机的ip地址和端口信息，短连接往往用不到，推迟到第一次使用
+        std::call_once(localAddrOnce_, [this]() {
+            sockaddr_in local;
+            ::memset(&local, 0, sizeof(local));
+            socklen_t addrlen = sizeof(local);
+            if (::getsockname(channel_.fd(), (sockaddr *)&local, &addrlen) < 0)
+            {
+                LOG_ERROR << "sockets::getLocalAddr() failed";
+            }
+            localAddr_.setSockAddr(local);
+        });
+    }
+    return localAddr_;
+}
+
+const std::string& TcpConnection::name() const
+{
+    if (namePrefix_)
+    {
+        // 可能在多个线程同时第一次调用；id 按 代数-分片-槽 分段以十六进制显示
+        std::call_once(nameOnce_, [this]() {
+            char buf[32];
+            snprintf(buf, sizeof buf, "%x-%x-%x", static_cast<unsigned>(id_ >> 48),
+                     static_cast<unsigned>((id_ >> 32) & 0xffff), static_cast<unsigned>(id_));
+            name_ = *namePrefix_ + buf;
+        });
+    }
+    return name_;
 }
 
 TcpConnection::~TcpConnection()
 {
-    LOG_INFO << "TcpConnection::dtor[" << name_.c_str() << "] at fd=" << channel_->fd() << " state=" << static_cast<int>(state_);
+    if (logLifecycle_)
+    {
+        LOG_INFO << "TcpConnection::dtor[" << name().c_str() << "] at fd=" << channel_.fd() << " state=" << static_cast<int>(state_);
+    }
+    // 关闭还没发送完的文件
+    for (const FileRegion &region : pendingFiles_)
+    {
+        ::close(region.fd);
+    }
 }
 
 
@@ -70,13 +149,30 @@ void TcpConnection::send(const std::string &buf)
         }
         else
         {
+            // 调用方的 buf 在IO线程执行时可能已经析构，不能只绑定裸指针，需要拷贝一份
             // 遇到重载函数的绑定，可以使用函数指针来指定确切的函数
-            void(TcpConnection::*fp)(const void* data, size_t len) = &TcpConnection::sendInLoop;
+            void(TcpConnection::*fp)(const std::string& message) = &TcpConnection::sendInLoop;
             loop_->runInLoop(std::bind(
                 fp,
-                this,
-                buf.c_str(),
-                buf.size()));
+                shared_from_this(),
+                buf));
+        }
+    }
+}
+
+void TcpConnection::send(std::string &&buf)
+{
+    if (state_ == kConnected)
+    {
+        if (loop_->isInLoopThread())
+        {
+            sendInLoop(buf.data(), buf.size());
+        }
+        else
+        {
+            // 字符串的所有权移入回调，跨线程也不拷贝数据
+            void(TcpConnection::*fp)(const std::string& message) = &TcpConnection::sendInLoop;
+            loop_->runInLoop(std::bind(fp, shared_from_this(), std::move(buf)));
         }
     }
 }
@@ -94,8 +190,146 @@ void TcpConnection::send(Buffer *buf)
         {
             // sendInLoop有多重重载，需要使用函数指针确定
             void (TcpConnection::*fp)(const std::string& message) = &TcpConnection::sendInLoop;
-            loop_->runInLoop(std::bind(fp, this, buf->retrieveAllAsString()));
+            loop_->runInLoop(std::bind(fp, shared_from_this(), buf->retrieveAllAsString()));
+        }
+    }
+}
+
+void TcpConnection::send(Buffer &&buf)
+{
+    if (state_ == kConnected)
+    {
+        if (loop_->isInLoopThread())
+        {
+            sendInLoop(buf.peek(), buf.readableBytes());
+            buf.retrieveAll();
+        }
+        else
+        {
+            // 整个 Buffer 移入回调，底层内存直接转移
+            loop_->runInLoop(std::bind(
+                &TcpConnection::sendBufferInLoop, shared_from_this(), std::move(buf)));
+        }
+    }
+}
+
+void TcpConnection::send(const std::shared_ptr<const std::string> &payload)
+{
+    if (state_ == kConnected)
+    {
+        if (loop_->isInLoopThread())
+        {
+            sendInLoop(payload->data(), payload->size());
+        }
+        else
+        {
+            // 只增加引用计数，多个连接可以共享同一份数据
+            loop_->runInLoop(std::bind(
+                &TcpConnection::sendPayloadInLoop, shared_from_this(), payload));
+        }
+    }
+}
+
+void TcpConnection::send(const BufferSlice &slice)
+{
+    if (state_ == kConnected)
+    {
+        if (loop_->isInLoopThread())
+        {
+            sendInLoop(slice.data(), slice.size());
+        }
+        else
+        {
+            loop_->runInLoop(std::bind(
+                &TcpConnection::sendSliceInLoop, shared_from_this(), slice));
+        }
+    }
+}
+
+void TcpConnection::sendBufferInLoop(const Buffer &buf)
+{
+    sendInLoop(buf.peek(), buf.readableBytes());
+}
+
+void TcpConnection::sendPayloadInLoop(const std::shared_ptr<const std::string> &payload)
+{
+    sendInLoop(payload->data(), payload->size());
+}
+
+void TcpConnection::sendSliceInLoop(const BufferSlice &slice)
+{
+    sendInLoop(slice.data(), slice.size());
+}
+
+void TcpConnection::send(const std::string_view *pieces, size_t count)
+{
+    if (state_ == kConnected)
+    {
+        if (loop_->isInLoopThread())
+        {
+            struct iovec stackVec[kMaxStackIovecs];
+            std::vector<struct iovec> heapVec;
+            struct iovec *vec = stackVec;
+            if (count > kMaxStackIovecs)
+            {
+                heapVec.resize(count);
+                vec = heapVec.data();
+            }
+            for (size_t i = 0; i < count; ++i)
+            {
+                vec[i].iov_base = const_cast<char*>(pieces[i].data());
+                vec[i].iov_len = pieces[i].size();
+            }
+            sendInLoop(vec, static_cast<int>(count));
+        }
+        else
+        {
+            // 调用方的内存在IO线程执行时可能已经失效，只能拼接拷贝一份
+            std::string message;
+            for (size_t i = 0; i < count; ++i)
+            {
+                message.append(pieces[i].data(), pieces[i].size());
+            }
+            void (TcpConnection::*fp)(const std::string& message) = &TcpConnection::sendInLoop;
+            loop_->runInLoop(std::bind(fp, shared_from_this(), std::move(message)));
+        }
+    }
+}
+
+void TcpConnection::send(std::vector<std::string> &&pieces)
+{
+    if (state_ == kConnected)
+    {
+        if (loop_->isInLoopThread())
+        {
+            sendPiecesInLoop(pieces);
+        }
+        else
+        {
+            loop_->runInLoop(std::bind(&TcpConnection::sendPiecesInLoop,
+                                       shared_from_this(), std::move(pieces)));
+        }
+    }
+}
+
+void TcpConnection::sendFile(int fd, off_t offset, size_t length)
+{
+    if (state_ == kConnected)
+    {
+        if (loop_->isInLoopThread())
+        {
+            sendFileInLoop(fd, offset, length);
         }
+        else
+        {
+            loop_->runInLoop(std::bind(
+                &TcpConnection::sendFileInLoop, shared_from_this(), fd, offset, length));
+        }
+    }
+    else
+    {
+        // fd 的所有权已经交给连接，无法发送时也要负责关闭
+        ::close(fd);
     }
 }
 
@@ -108,8 +342,24 @@ void TcpConnection::sendInLoop(const std::string& message)
  * 发送数据 应用写的快 而内核发送数据慢 需要把待发送数据写入缓冲区，而且设置了水位回调
  **/
 void TcpConnection::sendInLoop(const void* data, size_t len)
+{
+    struct iovec vec;
+    vec.iov_base = const_cast<void*>(data);
+    vec.iov_len = len;
+    sendInLoop(&vec, 1);
+}
+
+/**
+ * 聚集写版本，多段数据一次 writev 发出，剩余部分按顺序拷入缓冲区
+ **/
+void TcpConnection::sendInLoop(const struct iovec *iov, int iovcnt)
 {
     ssize_t nwrote = 0;
+    size_t len = 0;
+    for (int i = 0; i < iovcnt; ++i)
+    {
+        len += iov[i].iov_len;
+    }
     size_t remaining = len;
     bool faultError = false;
 
@@ -121,11 +371,24 @@ void TcpConnection::sendInLoop(const void* data, size_t len)
     }
 
     // channel第一次写数据，且缓冲区没有待发送数据
-    if (!channel_->isWriting() && outputBuffer_.readableBytes() == 0)
+    // 合并写模式下不直接写，统一留到本轮末尾冲刷
+    if (!coalescing_ && !channel_.isWriting() && outputBytes() == 0)
     {
-        nwrote = ::write(channel_->fd(), data, len);
+        if (iovcnt == 1)
+        {
+            nwrote = ::write(channel_.fd(), iov[0].iov_base, iov[0].iov_len);
+        }
+        else
+        {
+            // 超过 IOV_MAX 的部分留给缓冲区
+            nwrote = ::writev(channel_.fd(), iov, std::min(iovcnt, IOV_MAX));
+        }
         if (nwrote >= 0)
         {
+            if (traffic_)
+            {
+                traffic_->addOut(nwrote);
+            }
             // 判断有没有一次性写完
             remaining = len - nwrote;
             if (remaining == 0 && writeCompleteCallback_)
@@ -154,7 +417,7 @@ void TcpConnection::sendInLoop(const void* data, size_t len)
     // 说明一次性并没有发送完数据，剩余数据需要保存到缓冲区中，且需要改channel注册写事件
     if (!faultError && remaining > 0)
     {
-        size_t oldLen = outputBuffer_.readableBytes();
+        size_t oldLen = outputBytes();
         if (oldLen + remaining >= highWaterMark_ 
         && oldLen < highWaterMark_ 
         && highWaterMarkCallback_)
@@ -163,12 +426,157 @@ void TcpConnection::sendInLoop(const void* data, size_t len)
             loop_->queueInLoop(std::bind(
                 highWaterMarkCallback_, shared_from_this(), oldLen + remaining));
         }
-        outputBuffer_.append((char *)data + nwrote, remaining);
-        if (!channel_->isWriting())
+        // 跳过已经写出的 nwrote 字节，只拷贝未发送的尾部
+        size_t skip = nwrote;
+        for (int i = 0; i < iovcnt; ++i)
+        {
+            const char *base = static_cast<const char*>(iov[i].iov_base);
+            size_t n = iov[i].iov_len;
+            if (skip >= n)
+            {
+                skip -= n;
+                continue;
+            }
+            outputBuffer_.append(base + skip, n - skip);
+            skip = 0;
+        }
+        scheduleOutput();
+        if (flowControl_)
+        {
+            updateReading();
+        }
+    }
+}
+
+// 缓冲区里有了待发送数据，安排后续发送
+void TcpConnection::scheduleOutput()
+{
+    if (channel_.isWriting())
+    {
+        // 正在等待可写事件，由 handleWrite 接着发送
+        return;
+    }
+    if (coalescing_)
+    {
+        // 合并写模式下登记本轮末尾的冲刷，一轮只登记一次
+        if (!flushScheduled_)
+        {
+            flushScheduled_ = true;
+            loop_->runAtIterationEnd(
+                std::bind(&TcpConnection::flushCoalesced, shared_from_this()));
+        }
+    }
+    else
+    {
+        channel_.enableWriting(); // 这里一定要注册channel的写事件 否则poller不会给channel通知epollout
+    }
+}
+
+void TcpConnection::sendPiecesInLoop(const std::vector<std::string> &pieces)
+{
+    struct iovec stackVec[kMaxStackIovecs];
+    std::vector<struct iovec> heapVec;
+    struct iovec *vec = stackVec;
+    if (pieces.size() > kMaxStackIovecs)
+    {
+        heapVec.resize(pieces.size());
+        vec = heapVec.data();
+    }
+    for (size_t i = 0; i < pieces.size(); ++i)
+    {
+        vec[i].iov_base = const_cast<char*>(pieces[i].data());
+        vec[i].iov_len = pieces[i].size();
+    }
+    sendInLoop(vec, static_cast<int>(pieces.size()));
+}
+
+/**
+ * 发送文件 与 sendInLoop 的逻辑相同：能直接发就先发一部分，剩余部分排队
+ * 文件区间记录下它前面还有多少缓冲区字节，handleWrite 会严格按顺序交替发送
+ **/
+void TcpConnection::sendFileInLoop(int fd, off_t offset, size_t length)
+{
+    size_t remaining = length;
+    bool faultError = false;
+
+    if (state_ == kDisconnected)
+    {
+        LOG_ERROR << "disconnected, give up sending file";
+        ::close(fd);
+        return;
+    }
+
+    // 没有任何待发送数据时直接调用 sendfile，合并写模式下留到本轮末尾
+    if (!coalescing_ && !channel_.isWriting() && outputBytes() == 0)
+    {
+        ssize_t nwrote = ::sendfile(channel_.fd(), fd, &offset, length);
+        if (nwrote > 0)
+        {
+            if (traffic_)
+            {
+                traffic_->addOut(nwrote);
+            }
+            remaining = length - nwrote;
+            if (remaining == 0 && writeCompleteCallback_)
+            {
+                loop_->queueInLoop(
+                    std::bind(writeCompleteCallback_, shared_from_this())
+                );
+            }
+        }
+        else if (nwrote == 0 && length > 0)
+        {
+            // 文件比声明的长度短，对端永远等不齐约定的长度，直接关闭连接
+            LOG_ERROR << "TcpConnection::sendFileInLoop file is shorter than " << length;
+            ::close(fd);
+            forceCloseInLoop();
+            return;
+        }
+        else if (nwrote < 0 && errno != EWOULDBLOCK && errno != EINTR)
+        {
+            LOG_ERROR << "TcpConnection::sendFileInLoop";
+            if (errno == EPIPE || errno == ECONNRESET) // SIGPIPE
+            {
+                faultError = true;
+            }
+            else
+            {
+                // 文件这一侧的错误（EINVAL、EIO 等），排队重试也只会一直失败，直接关闭连接
+                ::close(fd);
+                forceCloseInLoop();
+                return;
+            }
+        }
+    }
+
+    if (!faultError && remaining > 0)
+    {
+        size_t oldLen = outputBytes();
+        if (oldLen + remaining >= highWaterMark_ 
+        && oldLen < highWaterMark_ 
+        && highWaterMarkCallback_)
+        {
+            loop_->queueInLoop(std::bind(
+                highWaterMarkCallback_, shared_from_this(), oldLen + remaining));
+        }
+        // 缓冲区中已有、但还不属于前面任何文件区间的字节都要先于本文件发出
+        size_t bytesBefore = outputBuffer_.readableBytes();
+        for (const FileRegion &region : pendingFiles_)
+        {
+            bytesBefore -= region.bytesBefore;
+        }
+        pendingFiles_.push_back(FileRegion{fd, offset, remaining, bytesBefore});
+        pendingFileBytes_ += remaining;
+        scheduleOutput();
+        if (flowControl_)
         {
-            channel_->enableWriting(); // 这里一定要注册channel的写事件 否则poller不会给channel通知epollout
+            updateReading();
         }
     }
+    else
+    {
+        ::close(fd);
+    }
 }
 
 // 关闭连接 
@@ -184,9 +592,64 @@ void TcpConnection::shutdown()
 
 void TcpConnection::shutdownInLoop()
 {
-    if (!channel_->isWriting()) // 说明当前outputBuffer_的数据全部向外发送完成
+    // 说明当前outputBuffer_的数据全部向外发送完成（合并写模式下可能还有数据等着本轮末尾冲刷）
+    if (!channel_.isWriting() && outputBytes() == 0)
+    {
+        socket_.shutdownWrite();
+    }
+}
+
+void TcpConnection::startRead()
+{
+    loop_->runInLoop(std::bind(&TcpConnection::startReadInLoop, shared_from_this()));
+}
+
+void TcpConnection::startReadInLoop()
+{
+    reading_ = true;
+    updateReading();
+}
+
+void TcpConnection::stopRead()
+{
+    loop_->runInLoop(std::bind(&TcpConnection::stopReadInLoop, shared_from_this()));
+}
+
+void TcpConnection::stopReadInLoop()
+{
+    reading_ = false;
+    updateReading();
+}
+
+void TcpConnection::updateReading()
+{
+    if (state_ == kDisconnected)
+    {
+        return;
+    }
+    if (flowControl_)
+    {
+        size_t pending = outputBytes();
+        if (!readPaused_ && pending >= highWaterMark_)
+        {
+            readPaused_ = true;
+            LOG_DEBUG << "TcpConnection " << name() << " pause reading, " << pending << " bytes pending";
+        }
+        else if (readPaused_ && pending <= lowWaterMark_)
+        {
+            readPaused_ = false;
+            LOG_DEBUG << "TcpConnection " << name() << " resume reading";
+        }
+    }
+
+    bool wanted = reading_ && !readPaused_;
+    if (wanted && !channel_.isReading())
     {
-        socket_->shutdownWrite();
+        channel_.enableReading();
+    }
+    else if (!wanted && channel_.isReading())
+    {
+        channel_.disableReading();
     }
 }
 
@@ -196,13 +659,23 @@ void TcpConnection::connectEstablished()
     setState(kConnected); // 建立连接，设置一开始状态为连接态
     /**
      * TODO:tie
-     * channel_->tie(shared_from_this());
+     * channel_.tie(shared_from_this());
      * tie相当于在底层有一个强引用指针记录着，防止析构
      * 为了防止TcpConnection这个资源被误删掉，而这个时候还有许多事件要处理
      * channel->tie 会进行一次判断，是否将弱引用指针变成强引用，变成得话就防止了计数为0而被析构得可能
      */
-    channel_->tie(shared_from_this());
-    channel_->enableReading(); // 向poller注册channel的EPOLLIN读事件
+    channel_.tie(shared_from_this());
+    if (loop_->cpu() >= 0)
+    {
+        // 缓冲区是在 mainLoop 线程构造的，在绑核的 IO 线程里重新创建，使其落在 IO 线程所在的 NUMA 节点
+        inputBuffer_ = Buffer(inputBuffer_.mode());
+        outputBuffer_ = Buffer(outputBuffer_.mode());
+    }
+    channel_.enableReading(); // 向poller注册channel的EPOLLIN读事件
+    if (idleWheel_)
+    {
+        idleWheel_->add(&idleEntry_, this);
+    }
 
     // 新连接建立 执行回调
     connectionCallback_(shared_from_this());
@@ -214,19 +687,37 @@ void TcpConnection::connectDestroyed()
     if (state_ == kConnected)
     {
         setState(kDisconnected);
-        channel_->disableAll(); // 把channel的所有感兴趣的事件从poller中删除掉
+        channel_.disableAll(); // 把channel的所有感兴趣的事件从poller中删除掉
         connectionCallback_(shared_from_this());
     }
-    channel_->remove(); // 把channel从poller中删除掉
+    if (idleWheel_)
+    {
+        idleWheel_->remove(&idleEntry_);
+    }
+    channel_.remove(); // 把channel从poller中删除掉
 }
 
 void TcpConnection::handleRead(Timestamp receiveTime)
 {
+    if (idleWheel_)
+    {
+        idleWheel_->touch(&idleEntry_);
+    }
+    if (channel_.edgeTriggered())
+    {
+        handleReadEdgeTriggered(receiveTime);
+        return;
+    }
+
     int savedErrno = 0;
     // TcpConnection会从socket读取数据，然后写入inpuBuffer
-    ssize_t n = inputBuffer_.readFd(channel_->fd(), &savedErrno);
+    ssize_t n = inputBuffer_.readFd(channel_.fd(), &savedErrno);
     if (n > 0)
     {
+        if (traffic_)
+        {
+            traffic_->addIn(n);
+        }
         // 已建立连接的用户，有可读事件发生，调用用户传入的回调操作
         // TODO:shared_from_this
         messageCallback_(shared_from_this(), &inputBuffer_, receiveTime);
@@ -245,31 +736,90 @@ void TcpConnection::handleRead(Timestamp receiveTime)
     }
 }
 
-void TcpConnection::handleWrite()
+void TcpConnection::setSocketBusyPoll(int usec)
+{
+    socket_.setBusyPoll(usec);
+}
+
+void TcpConnection::setEdgeTriggered(bool on)
+{
+    channel_.setEdgeTriggered(on);
+}
+
+ssize_t TcpConnection::writeOutput(int *saveErrno)
 {
-    if (channel_->isWriting())
+    ssize_t n = 0;
+    if (!pendingFiles_.empty() && pendingFiles_.front().bytesBefore == 0)
     {
-        int saveErrno = 0;
-        ssize_t n = outputBuffer_.writeFd(channel_->fd(), &saveErrno);
-        // 正确读取数据
+        // 轮到排队的文件，由内核直接从页缓存发送
+        n = writeFileRegion(saveErrno);
+    }
+    else
+    {
+        // 有文件排队时只发送排在它前面的那部分缓冲区数据
+        size_t limit = pendingFiles_.empty() ? outputBuffer_.readableBytes()
+                                             : pendingFiles_.front().bytesBefore;
+        // 分段模式下 writeFd 会用 writev 一次性提交所有待发送分段
+        n = outputBuffer_.writeFd(channel_.fd(), saveErrno, limit);
         if (n > 0)
         {
             outputBuffer_.retrieve(n);
+            if (!pendingFiles_.empty())
+            {
+                pendingFiles_.front().bytesBefore -= n;
+            }
+        }
+    }
+    if (n > 0 && traffic_)
+    {
+        traffic_->addOut(n);
+    }
+    return n;
+}
+
+void TcpConnection::handleWrite()
+{
+    if (idleWheel_)
+    {
+        idleWheel_->touch(&idleEntry_);
+    }
+    if (channel_.isWriting())
+    {
+        int saveErrno = 0;
+        ssize_t n = 0;
+        size_t total = 0;
+        int iterations = 0;
+        // 水平触发只写一次；边缘触发一直写到写完、EAGAIN 或预算用完
+        do
+        {
+            n = writeOutput(&saveErrno);
+            ++iterations;
+            if (n > 0)
+            {
+                total += n;
+            }
+        } while (channel_.edgeTriggered() && n > 0 && outputBytes() > 0
+                 && total < drainBudgetBytes_ && iterations < drainBudgetIterations_);
+
+        // 正确写出数据
+        if (total > 0)
+        {
+            // 输出降到低水位以下，恢复被流控暂停的读
+            if (readPaused_)
+            {
+                updateReading();
+            }
             // 说明buffer可读数据都被TcpConnection读取完毕并写入给了客户端
             // 此时就可以关闭连接，否则还需继续提醒写事件
-            if (outputBuffer_.readableBytes() == 0)
+            if (outputBytes() == 0)
             {
-                channel_->disableWriting();
-                // 调用用户自定义的写完数据处理函数
-                if (writeCompleteCallback_)
-                {
-                    // 唤醒loop_对应得thread线程，执行写完成事件回调
-                    loop_->queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
-                }
-                if (state_ == kDisconnecting)
-                {
-                    shutdownInLoop();
-                }
+                channel_.disableWriting();
+                handleOutputDrained();
+            }
+            else if (channel_.edgeTriggered() && n > 0)
+            {
+                // 预算用完时 socket 仍然可写，边缘触发不会再通知，挂到本轮末尾继续写
+                loop_->queueInLoop(std::bind(&TcpConnection::continueWrite, shared_from_this()));
             }
         }
         else
@@ -280,14 +830,197 @@ void TcpConnection::handleWrite()
     // state_不为写状态
     else
     {
-        LOG_ERROR << "TcpConnection fd=" << channel_->fd() << " is down, no more writing";
+        LOG_ERROR << "TcpConnection fd=" << channel_.fd() << " is down, no more writing";
+    }
+}
+
+void TcpConnection::handleOutputDrained()
+{
+    // 调用用户自定义的写完数据处理函数
+    if (writeCompleteCallback_)
+    {
+        // 唤醒loop_对应得thread线程，执行写完成事件回调
+        loop_->queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
+    }
+    if (state_ == kDisconnecting)
+    {
+        shutdownInLoop();
+    }
+}
+
+/**
+ * 合并写：本轮里所有 send 追加的数据在这里一次发出
+ * 分段缓冲区一次 writev 提交全部分段；写不完的部分照常交给 handleWrite
+ **/
+void TcpConnection::flushCoalesced()
+{
+    flushScheduled_ = false;
+    if (state_ == kDisconnected || channel_.isWriting() || outputBytes() == 0)
+    {
+        return;
+    }
+
+    if (corkOnFlush_)
+    {
+        socket_.setTcpCork(true);
+    }
+    int saveErrno = 0;
+    ssize_t n = 0;
+    do
+    {
+        n = writeOutput(&saveErrno);
+    } while (n > 0 && outputBytes() > 0);
+    if (corkOnFlush_)
+    {
+        socket_.setTcpCork(false);
+    }
+
+    if (n < 0 && saveErrno != EWOULDBLOCK)
+    {
+        errno = saveErrno;
+        LOG_ERROR << "TcpConnection::flushCoalesced";
+    }
+    if (state_ == kDisconnected)
+    {
+        // 发送文件时可能因为文件被截断而强制关闭
+        return;
+    }
+    if (n < 0 && (saveErrno == EPIPE || saveErrno == ECONNRESET))
+    {
+        // 对端已经关闭，缓冲区里的数据再也发不出去，直接关闭连接
+        handleClose();
+        return;
+    }
+    if (readPaused_)
+    {
+        updateReading();
+    }
+    if (outputBytes() == 0)
+    {
+        handleOutputDrained();
+    }
+    else
+    {
+        // 没写完、EAGAIN 或暂时性的错误（EINTR、ENOBUFS 等），交给可写事件继续发送
+        channel_.enableWriting();
+    }
+}
+
+void TcpConnection::handleReadEdgeTriggered(Timestamp receiveTime)
+{
+    int savedErrno = 0;
+    ssize_t n = 0;
+    size_t total = 0;
+    int iterations = 0;
+    // 边缘触发只在状态变化时通知一次，必须读到 EAGAIN 为止
+    while (total < drainBudgetBytes_ && iterations < drainBudgetIterations_)
+    {
+        n = inputBuffer_.readFd(channel_.fd(), &savedErrno);
+        ++iterations;
+        if (n <= 0)
+        {
+            break;
+        }
+        total += n;
+    }
+
+    // 本次读到的数据合并成一次回调交给用户
+    if (total > 0)
+    {
+        if (traffic_)
+        {
+            traffic_->addIn(static_cast<int64_t>(total));
+        }
+        messageCallback_(shared_from_this(), &inputBuffer_, receiveTime);
+    }
+
+    if (n == 0)
+    {
+        // 对端关闭连接
+        handleClose();
+    }
+    else if (n < 0)
+    {
+        if (savedErrno != EAGAIN && savedErrno != EWOULDBLOCK)
+        {
+            errno = savedErrno;
+            LOG_ERROR << "TcpConnection::handleRead() failed";
+            handleError();
+        }
+    }
+    else if ((state_ == kConnected || state_ == kDisconnecting) && channel_.isReading())
+    {
+        // 预算用完但 socket 里可能还有数据，边缘触发不会再通知，挂到本轮末尾继续读
+        loop_->queueInLoop(std::bind(&TcpConnection::continueRead, shared_from_this()));
+    }
+}
+
+void TcpConnection::continueRead()
+{
+    // 期间连接可能已经关闭或停止读
+    if (channel_.isReading())
+    {
+        handleReadEdgeTriggered(loop_->pollReturnTime());
+    }
+}
+
+void TcpConnection::continueWrite()
+{
+    if (channel_.isWriting())
+    {
+        handleWrite();
+    }
+}
+
+ssize_t TcpConnection::writeFileRegion(int *saveErrno)
+{
+    FileRegion &region = pendingFiles_.front();
+    ssize_t n = ::sendfile(channel_.fd(), region.fd, &region.offset, region.remaining);
+    if (n > 0)
+    {
+        region.remaining -= n;
+        pendingFileBytes_ -= n;
+        if (region.remaining == 0)
+        {
+            ::close(region.fd);
+            pendingFiles_.pop_front();
+        }
+    }
+    else if (n < 0 && (errno == EWOULDBLOCK || errno == EINTR))
+    {
+        *saveErrno = errno;
+    }
+    else
+    {
+        /**
+         * n == 0 说明文件被截断；其他错误（EINVAL、EIO、对端重置等）重试也不会成功。
+         * 后续数据已经无法与对端约定的长度对齐，丢弃这个区间并关闭连接
+         */
+        if (n < 0)
+        {
+            *saveErrno = errno;
+            LOG_ERROR << "TcpConnection::writeFileRegion sendfile failed, fd=" << region.fd;
+        }
+        else
+        {
+            LOG_ERROR << "TcpConnection::writeFileRegion file is shorter than expected, fd=" << region.fd;
+        }
+        pendingFileBytes_ -= region.remaining;
+        ::close(region.fd);
+        pendingFiles_.pop_front();
+        forceCloseInLoop();
     }
+    return n;
 }
 
 void TcpConnection::handleClose()
 {
     setState(kDisconnected);    // 设置状态为关闭连接状态
-    channel_->disableAll();     // 注销Channel所有感兴趣事件
+    channel_.disableAll();     // 注销Channel所有感兴趣事件
+    if (idleWheel_)
+    {
+        idleWheel_->remove(&idleEntry_);
+    }
     
     TcpConnectionPtr connPtr(shared_from_this());
     connectionCallback_(connPtr);   
@@ -300,7 +1033,7 @@ void TcpConnection::handleError()
     socklen_t optlen = sizeof(optval);
     int err = 0;
     // TODO:getsockopt ERROR
-    if (::getsockopt(channel_->fd(), SOL_SOCKET, SO_ERROR, &optval, &optlen))
+    if (::getsockopt(channel_.fd(), SOL_SOCKET, SO_ERROR, &optval, &optlen))
     {
         err = errno;
     }
@@ -308,7 +1041,7 @@ void TcpConnection::handleError()
     {
         err = optval;
     }
-    LOG_ERROR << "cpConnection::handleError name:" << name_.c_str() << " - SO_ERROR:" << err;
+    LOG_ERROR << "cpConnection::handleError name:" << name().c_str() << " - SO_ERROR:" << err;
 }
 
 void TcpConnection::forceClose()
@@ -2,20 +2,28 @@
 #define TCP_CONNECTION_H
 
 #include <memory>
+#include <mutex>
 #include <string>
 #include <atomic>
 #include <string>
 #include <any>
+#include <deque>
+#include <vector>
+#include <string_view>
+#include <sys/types.h>
+#include <sys/uio.h>
 
 #include "noncopyable.h"
 #include "Callback.h"
 #include "Buffer.h"
 #include "Timestamp.h"
 #include "InetAddress.h"
+#include "IdleWheel.h"
+#include "Socket.h"
+#include "Channel.h"
+#include "LoopMetrics.h"
 
-class Channel;
 class EventLoop;
-class Socket;
 
 class TcpConnection : noncopyable, 
     public std::enable_shared_from_this<TcpConnection>
@@ -26,11 +34,32 @@ public:
                 int sockfd,
                 const InetAddress &localAddr,
                 const InetAddress &peerAddr);
+    /**
+     * 短连接快速路径使用（见 TcpServer::setShortLivedFastPath）：
+     * 名字由 setId 按需生成，本端地址在第一次调用 localAddress() 时才用 getsockname 获取，
+     * logLifecycle 为 false 时构造和析构不打印日志
+     */
+    TcpConnection(EventLoop *loop,
+                int sockfd,
+                const InetAddress &peerAddr,
+                bool logLifecycle = false);
     ~TcpConnection();
 
     EventLoop* getLoop() const { return loop_; }
-    const std::string& name() const { return name_; }
-    const InetAddress& localAddress() const { return localAddr_; }
+    // 连接名；使用 setId 的连接在第一次调用时才生成
+    const std::string& name() const;
+    // 连接在所属 IO 线程登记表中的 id（见 ConnectionRegistry），没有登记时为 0
+    uint64_t id() const { return id_; }
+    /**
+     * 以 id 标识连接，名字推迟到第一次调用 name() 时按 namePrefix + id 生成
+     * 只能在 connectEstablished 之前调用
+     */
+    void setId(uint64_t id, const std::shared_ptr<const std::string> &namePrefix)
+    {
+        id_ = id;
+        namePrefix_ = namePrefix;
+    }
+    const InetAddress& localAddress() const;
     const InetAddress& peerAddress() const { return peerAddr_; }
 
     bool connected() const { return state_ == kConnected; }
@@ -38,10 +67,50 @@ public:
     // 发送数据
     void send(const std::string &buf);
     void send(Buffer *buf);
+    /**
+     * 以下重载把数据的所有权转移(或共享)给连接
+     * 在非IO线程调用时数据随回调一起移交给IO线程，不会再拷贝一次
+     */
+    void send(std::string &&buf);
+    void send(Buffer &&buf);
+    // 引用计数的共享数据，适合把同一份响应发给多个连接
+    void send(const std::shared_ptr<const std::string> &payload);
+    void send(const BufferSlice &slice);
+    /**
+     * 聚集写：多段数据在IO线程中用一次 writev 发出，只有没发完的尾部才会拷入 outputBuffer_
+     * 跨线程调用时 string_view 指向的内存无法保证存活，会先拼接成一个 string
+     */
+    void send(const std::string_view *pieces, size_t count);
+    // 同上，但数据的所有权移交给连接，跨线程调用也不需要拼接
+    void send(std::vector<std::string> &&pieces);
+    /**
+     * 使用 sendfile 零拷贝发送文件 fd 中 [offset, offset + length) 的内容
+     * 按调用顺序排在之前已缓存的数据之后；fd 的所有权转移给连接，发送完或连接销毁时关闭
+     */
+    void sendFile(int fd, off_t offset, size_t length);
 
     // 关闭连接
     void shutdown();
 
+    /**
+     * 合并写模式，只能在 connectEstablished 之前调用
+     * 一轮 loop 中的 send 只追加到输出缓冲区，本轮末尾统一 writev 一次；
+     * useCork 为 true 时冲刷期间加 TCP_CORK，缓冲区和文件数据尽量凑成满段
+     */
+    void setWriteCoalescing(bool on, bool useCork = false)
+    {
+        coalescing_ = on;
+        corkOnFlush_ = useCork;
+    }
+
+    // 为连接 socket 设置 SO_BUSY_POLL，配合 EventLoop::setBusyPoll 使用
+    void setSocketBusyPoll(int usec);
+
+    // 暂停 / 恢复从 socket 读取数据，可跨线程调用
+    void startRead();
+    void stopRead();
+    bool isReading() const { return reading_; }
+
     // 保存用户自定义的回调函数
     void setConnectionCallback(const ConnectionCallback &cb)
     { connectionCallback_ = cb; }
@@ -53,7 +122,47 @@ public:
     { closeCallback_ = cb; }
     void setHighWaterMarkCallback(const HighWaterMarkCallback &cb, size_t highWaterMark)
     { highWaterMarkCallback_ = cb; highWaterMark_ = highWaterMark; }
+
+    /**
+     * 自动流控：待发送数据达到 highWaterMark 时暂停读，降到 lowWaterMark 以下再恢复
+     * 对端只发不收时，单个连接的输出缓冲区不会无限增长，应用层无需任何处理
+     */
+    void setFlowControl(size_t highWaterMark, size_t lowWaterMark)
+    {
+        flowControl_ = true;
+        highWaterMark_ = highWaterMark;
+        lowWaterMark_ = lowWaterMark;
+    }
+
+    // 设置输入输出缓冲区的模式，只能在 connectEstablished 之前调用
+    void setBufferMode(Buffer::Mode mode)
+    {
+        inputBuffer_ = Buffer(mode);
+        outputBuffer_ = Buffer(mode);
+    }
+
+    /**
+     * 边缘触发模式，只能在 connectEstablished 之前调用
+     * 一次事件里循环读写直到 EAGAIN，但最多处理 drainBudget 字节 / 次数，
+     * 预算用完还没读写完的连接挂到本轮末尾继续，避免一个快连接饿死同一 loop 上的其他连接
+     */
+    static const size_t kDefaultDrainBytes = 1024 * 1024;
+    static const int kDefaultDrainIterations = 16;
+    void setEdgeTriggered(bool on);
+    void setDrainBudget(size_t maxBytes, int maxIterations)
+    {
+        drainBudgetBytes_ = maxBytes;
+        drainBudgetIterations_ = maxIterations;
+    }
     
+    /**
+     * 空闲超时回收，只能在 connectEstablished 之前调用，wheel 必须属于本连接的 loop
+     * 有读写事件时刷新活跃时间，超过 wheel 的超时时间没有读写就被强制关闭
+     */
+    void setIdleWheel(const std::shared_ptr<IdleWheel> &wheel) { idleWheel_ = wheel; }
+    // 收发字节数计入 counters（所属 TcpServer 在本 IO 线程上的计数），需在 connectEstablished 之前设置
+    void setTrafficCounters(const std::shared_ptr<TrafficCounters> &counters) { traffic_ = counters; }
+
     // TcpServer会调用
     void connectEstablished(); // 连接建立
     void connectDestroyed();   // 连接销毁
@@ -80,26 +189,81 @@ private:
     };    
     void setState(StateE state) { state_ = state; }
 
+    // 两个公有构造函数共用
+    TcpConnection(EventLoop *loop,
+                const std::string &nameArg,
+                int sockfd,
+                const InetAddress &localAddr,
+                bool localAddrKnown,
+                const InetAddress &peerAddr,
+                bool logLifecycle);
+
     // 注册到channel上的回调函数，poller通知后会调用这些函数处理
     // 然后这些函数最后会再调用从用户那里传来的回调函数
     void handleRead(Timestamp receiveTime);
     void handleWrite();
     void handleClose();
+    // 边缘触发模式下预算用完后的续读 / 续写
+    void handleReadEdgeTriggered(Timestamp receiveTime);
+    void continueRead();
+    void continueWrite();
+    // 有新的待发送数据时安排发送：注册写事件或登记本轮末尾冲刷
+    void scheduleOutput();
+    // 合并写模式下本轮末尾的统一冲刷
+    void flushCoalesced();
+    // 输出全部发完后的收尾：关写事件、写完成回调、半关闭
+    void handleOutputDrained();
+    // 写出一段待发送数据（缓冲区或文件），返回值同 write
+    ssize_t writeOutput(int *saveErrno);
     void handleError();
 
     void sendInLoop(const void* message, size_t len);
     void sendInLoop(const std::string& message);
+    void sendInLoop(const struct iovec *iov, int iovcnt);
+    void sendPiecesInLoop(const std::vector<std::string> &pieces);
+    void sendBufferInLoop(const Buffer &buf);
+    void sendPayloadInLoop(const std::shared_ptr<const std::string> &payload);
+    void sendSliceInLoop(const BufferSlice &slice);
+    void sendFileInLoop(int fd, off_t offset, size_t length);
     void shutdownInLoop();
+    void startReadInLoop();
+    void stopReadInLoop();
+    // 按用户的读意愿和流控状态调整 channel 的读事件
+    void updateReading();
+
+    // 聚集写时在栈上准备的 iovec 个数，超出时改用堆上数组
+    static const size_t kMaxStackIovecs = 16;
+
+    // 待发送的文件区间
+    struct FileRegion
+    {
+        int fd;
+        off_t offset;
+        size_t remaining;
+        size_t bytesBefore; // 在它之前还需从 outputBuffer_ 发出的字节数
+    };
+    // 发送队首文件区间的一部分，返回值同 sendfile
+    ssize_t writeFileRegion(int *saveErrno);
+    // 尚未发出的全部数据：缓冲区中的字节 + 排队文件的剩余字节
+    size_t outputBytes() const { return outputBuffer_.readableBytes() + pendingFileBytes_; }
     
     EventLoop *loop_;           // 属于哪个subLoop（如果是单线程则为mainLoop）
-    const std::string name_;
+    mutable std::string name_;
+    uint64_t id_;
+    std::shared_ptr<const std::string> namePrefix_;   // 非空表示名字按需生成
+    mutable std::once_flag nameOnce_;
     std::atomic_int state_;     // 连接状态
-    bool reading_;
+    bool reading_;              // 用户是否希望读（stopRead 置为 false）
+    bool readPaused_;           // 是否因输出积压被流控暂停读
 
-    std::unique_ptr<Socket> socket_;;
-    std::unique_ptr<Channel> channel_;
+    // 和连接对象一起分配，建立一个连接只有一次堆分配（见 TcpServer::setShortLivedFastPath）
+    Socket socket_;
+    Channel channel_;
 
-    const InetAddress localAddr_;   // 本服务器地址
+    mutable InetAddress localAddr_; // 本服务器地址
+    const bool localAddrKnown_;     // 为 false 时 localAddr_ 按需获取
+    mutable std::once_flag localAddrOnce_;
+    const bool logLifecycle_;       // 构造和析构是否打印日志
     const InetAddress peerAddr_;    // 对端地址
 
     /**
@@ -112,9 +276,24 @@ private:
     CloseCallback closeCallback_;                   // 客户端关闭连接的回调
     HighWaterMarkCallback highWaterMarkCallback_;   // 超出水位实现的回调
     size_t highWaterMark_;
+    size_t lowWaterMark_;
+    bool flowControl_;
+
+    bool coalescing_;       // 是否合并一轮内的写
+    bool corkOnFlush_;      // 合并冲刷时是否使用 TCP_CORK
+    bool flushScheduled_;   // 本轮末尾是否已登记冲刷
 
     Buffer inputBuffer_;    // 读取数据的缓冲区
     Buffer outputBuffer_;   // 发送数据的缓冲区
+    std::deque<FileRegion> pendingFiles_;   // 排队等待 sendfile 的文件区间
+    size_t pendingFileBytes_;               // 排队文件的剩余字节总数
+
+    size_t drainBudgetBytes_;   // 边缘触发模式下一次事件最多读写的字节数
+    int drainBudgetIterations_; // 边缘触发模式下一次事件最多调用 read / write 的次数
+
+    std::shared_ptr<IdleWheel> idleWheel_;  // 为空表示不做空闲回收
+    std::shared_ptr<TrafficCounters> traffic_;  // 为空表示不统计收发字节数
+    IdleWheel::Entry idleEntry_;            // 在 idleWheel_ 上的节点
 
     std::any context_;
 };
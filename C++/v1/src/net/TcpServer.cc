@@ -4,6 +4,7 @@
 #include "TcpServer.h"
 #include "TcpConnection.h"
 #include "Logging.h"
+#include "ConnectionAllocator.h"
 
 // 检查传入的 baseLoop 指针是否有意义
 static EventLoop *CheckLoopNotNull(EventLoop *loop)
@@ -20,6 +21,7 @@ TcpServer::TcpServer(EventLoop *loop,
                      const std::string &nameArg,
                      Option option)
     : loop_(CheckLoopNotNull(loop)),
+    listenAddr_(listenAddr),
     ipPort_(listenAddr.toIpPort()),
     name_(nameArg),
     acceptor_(new Acceptor(loop, listenAddr, option == kReusePort)),
@@ -29,7 +31,29 @@ TcpServer::TcpServer(EventLoop *loop,
     writeCompleteCallback_(),
     threadInitCallback_(),
     started_(0),
-    nextConnId_(1)    
+    nextConnId_(1),
+    bufferMode_(Buffer::kContiguous),
+    edgeTriggered_(false),
+    drainBudgetBytes_(TcpConnection::kDefaultDrainBytes),
+    drainBudgetIterations_(TcpConnection::kDefaultDrainIterations),
+    writeCoalescing_(false),
+    corkOnFlush_(false),
+    busyPollSeconds_(0.0),
+    socketBusyPollUs_(0),
+    flowHighWaterMark_(0),
+    flowLowWaterMark_(0),
+    idleTimeoutSeconds_(0.0),
+    steerByIncomingCpu_(false),
+    acceptPerLoop_(false),
+    acceptCpuSteering_(false),
+    shardedRegistry_(false),
+    shortLivedFastPath_(false),
+    connectionLogging_(true),
+    acceptBatch_(Acceptor::kDefaultAcceptBatch),
+    maxConnections_(0),
+    maxConnectionsPerLoop_(0),
+    numConnections_(0),
+    rejectedConnections_(0)
 {
     // 当有新用户连接时，Acceptor类中绑定的acceptChannel_会有读事件发生执行handleRead()调用TcpServer::newConnection回调
     acceptor_->setNewConnectionCallback(
@@ -47,9 +71,63 @@ TcpServer::~TcpServer()
         conn->getLoop()->runInLoop(
             std::bind(&TcpConnection::connectDestroyed, conn));
     }
+    /**
+     * 各 IO 线程的监听套接字和连接交给所属线程销毁，并等到全部完成：
+     * 监听套接字的回调指向本对象，析构返回之后（成员随即销毁，IO 线程还在运行）不能再分发 accept 事件
+     * 所属 loop 已经停止时投递的任务不会执行，定期检查，baseLoop 停止了就由本线程直接销毁
+     */
+    std::shared_ptr<TeardownLatch> latch = std::make_shared<TeardownLatch>(loopStates_.size());
+    for (auto &item : loopStates_)
+    {
+        item.first->runInLoop(std::bind(&TcpServer::teardownLoopState, item.second, latch));
+    }
+    std::unique_lock<std::mutex> lock(latch->mutex);
+    while (!latch->cond.wait_for(lock, std::chrono::milliseconds(100),
+                                 [&latch]() { return latch->remaining == 0; }))
+    {
+        lock.unlock();
+        for (auto &item : loopStates_)
+        {
+            if (item.second->tornDown.load(std::memory_order_acquire) || threadPool_->isLoopRunning(item.first))
+            {
+                continue;
+            }
+            if (item.first != loop_)
+            {
+                // subLoop 的 EventLoop 已经随线程销毁，没法再注销它上面的 channel
+                LOG_FATAL << "TcpServer [" << name_.c_str() << "] - io loop " << item.first << " quit before the server was destroyed";
+            }
+            teardownLoopState(item.second, latch);
+        }
+        lock.lock();
+    }
+}
+
+void TcpServer::teardownLoopState(const std::shared_ptr<LoopState> &state,
+                                  const std::shared_ptr<TeardownLatch> &latch)
+{
+    if (state->tornDown.exchange(true, std::memory_order_acq_rel))
+    {
+        return;
+    }
+    state->acceptor.reset();
+    std::vector<TcpConnectionPtr> conns;
+    state->registry.takeAll(&conns);
+    for (const TcpConnectionPtr &conn : conns)
+    {
+        conn->connectDestroyed();
+    }
+    std::lock_guard<std::mutex> lock(latch->mutex);
+    --latch->remaining;
+    latch->cond.notify_one();
 }
 
 // 设置底层subloop的个数
+void TcpServer::setPollerBackend(PollerBackend backend)
+{
+    threadPool_->setPollerBackend(backend);
+}
+
 void TcpServer::setThreadNum(int numThreads)
 {
     threadPool_->setThreadNum(numThreads);
@@ -63,46 +141,149 @@ void TcpServer::start()
     {
         // 启动底层的lopp线程池
         threadPool_->start(threadInitCallback_);
-        // acceptor_.get()绑定时候需要地址
-        loop_->runInLoop(std::bind(&Acceptor::listen, acceptor_.get()));
+        for (EventLoop *loop : threadPool_->getAllLoops())
+        {
+            traffic_[loop] = std::make_shared<TrafficCounters>();
+        }
+        if (busyPollSeconds_ > 0.0)
+        {
+            // 只有处理连接的 IO 线程忙轮询（没有 subLoop 时就是 mainLoop）
+            for (EventLoop *loop : threadPool_->getAllLoops())
+            {
+                loop->setBusyPoll(busyPollSeconds_);
+            }
+        }
+        if (idleTimeoutSeconds_ > 0.0)
+        {
+            for (EventLoop *loop : threadPool_->getAllLoops())
+            {
+                std::shared_ptr<IdleWheel> wheel(new IdleWheel(loop, idleTimeoutSeconds_));
+                wheel->start();
+                idleWheels_[loop] = wheel;
+            }
+        }
+        std::shared_ptr<ConnectionOptions> options = std::make_shared<ConnectionOptions>();
+        options->bufferMode = bufferMode_;
+        options->edgeTriggered = edgeTriggered_;
+        options->drainBudgetBytes = drainBudgetBytes_;
+        options->drainBudgetIterations = drainBudgetIterations_;
+        options->writeCoalescing = writeCoalescing_;
+        options->corkOnFlush = corkOnFlush_;
+        options->socketBusyPollUs = socketBusyPollUs_;
+        options->flowHighWaterMark = flowHighWaterMark_;
+        options->flowLowWaterMark = flowLowWaterMark_;
+        options->shortLivedFastPath = shortLivedFastPath_;
+        options->logging = connectionLogging_;
+        options->idleWheels = idleWheels_;
+        options->traffic = traffic_;
+        options->connectionCallback = connectionCallback_;
+        options->messageCallback = messageCallback_;
+        options->writeCompleteCallback = writeCompleteCallback_;
+        options_ = options;
+        if (acceptPerLoop_ || shardedRegistry_ || shortLivedFastPath_)
+        {
+            startLoopStates();
+        }
+        if (!acceptPerLoop_)
+        {
+            acceptor_->setAcceptBatch(acceptBatch_);
+            // acceptor_.get()绑定时候需要地址
+            loop_->runInLoop(std::bind(&Acceptor::listen, acceptor_.get()));
+        }
+    }
+}
+
+void TcpServer::startLoopStates()
+{
+    std::shared_ptr<const std::string> namePrefix(new std::string(name_ + "-" + ipPort_ + "#"));
+    std::vector<EventLoop *> loops = threadPool_->getAllLoops();
+    for (size_t i = 0; i < loops.size(); ++i)
+    {
+        loopStates_[loops[i]] = std::make_shared<LoopState>(static_cast<uint16_t>(i), namePrefix, connectionLogging_);
+    }
+    if (!acceptPerLoop_)
+    {
+        return;
+    }
+
+    // acceptor_ 只绑定不 listen，不加入 SO_REUSEPORT 组，不会分到连接
+    std::vector<int> cpuOfIndex;
+    for (EventLoop *ioLoop : loops)
+    {
+        std::shared_ptr<LoopState> &state = loopStates_[ioLoop];
+        state->acceptor.reset(new Acceptor(ioLoop, listenAddr_, true));
+        state->acceptor->setAcceptBatch(acceptBatch_);
+        state->acceptor->setNewConnectionCallback(
+            std::bind(&TcpServer::newConnectionInLoop, this, ioLoop, std::weak_ptr<LoopState>(state),
+                      std::placeholders::_1, std::placeholders::_2));
+        // 按 loops 的顺序在本线程 listen，组内下标和 loops 的下标一致
+        state->acceptor->listenSocket();
+        cpuOfIndex.push_back(ioLoop->cpu());
+    }
+    if (acceptCpuSteering_ && !loops.empty())
+    {
+        loopStates_[loops.front()]->acceptor->socket().attachReusePortCpuSteering(cpuOfIndex);
+    }
+    for (EventLoop *ioLoop : loops)
+    {
+        ioLoop->runInLoop(std::bind(&Acceptor::listen, loopStates_[ioLoop]->acceptor.get()));
     }
 }
 
 // 有一个新用户连接，acceptor会执行这个回调操作，负责将mainLoop接收到的请求连接(acceptChannel_会有读事件发生)通过回调轮询分发给subLoop去处理
 void TcpServer::newConnection(int sockfd, const InetAddress &peerAddr)
 {
-    // 轮询算法 选择一个subLoop 来管理connfd对应的channel
-    EventLoop *ioLoop = threadPool_->getNextLoop();
-    // 提示信息
-    char buf[64] = {0};
-    snprintf(buf, sizeof buf, "-%s#%d", ipPort_.c_str(), nextConnId_);
-    // 这里没有设置为原子类是因为其只在mainloop中执行 不涉及线程安全问题
-    ++nextConnId_;  
-    // 新连接名字
-    std::string connName = name_ + buf;
-
-    LOG_INFO << "TcpServer::newConnection [" << name_.c_str() << "] - new connection [" << connName.c_str() << "] from " << peerAddr.toIpPort().c_str();
-    
-    // 通过sockfd获取其绑定的本机的ip地址和端口信息
-    sockaddr_in local;
-    ::memset(&local, 0, sizeof(local));
-    socklen_t addrlen = sizeof(local);
-    if(::getsockname(sockfd, (sockaddr *)&local, &addrlen) < 0)
-    {
-        LOG_ERROR << "sockets::getLocalAddr() failed";
-    }
-
-    InetAddress localAddr(local);
-    TcpConnectionPtr conn(new TcpConnection(ioLoop,
-                                            connName,
-                                            sockfd,
-                                            localAddr,
-                                            peerAddr));
-    connections_[connName] = conn;
-    // 下面的回调都是用户设置给TcpServer => TcpConnection的，至于Channel绑定的则是TcpConnection设置的四个，handleRead,handleWrite... 这下面的回调用于handlexxx函数中
-    conn->setConnectionCallback(connectionCallback_);
-    conn->setMessageCallback(messageCallback_);
-    conn->setWriteCompleteCallback(writeCompleteCallback_);
+    // 按分配策略（默认轮询）选择一个subLoop 来管理connfd对应的channel
+    EventLoop *ioLoop = nullptr;
+#ifdef SO_INCOMING_CPU
+    if (steerByIncomingCpu_)
+    {
+        // 交给和网卡队列同一 CPU 的 subLoop，收包和处理不跨核
+        int cpu = -1;
+        socklen_t len = sizeof(cpu);
+        if (::getsockopt(sockfd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len) == 0 && cpu >= 0)
+        {
+            ioLoop = threadPool_->getLoopForCpu(cpu);
+        }
+    }
+#endif
+    if (ioLoop == nullptr)
+    {
+        ioLoop = threadPool_->getLoopForConnection(peerAddr);
+    }
+    if (!admitConnection(ioLoop, sockfd))
+    {
+        return;
+    }
+    if (shortLivedFastPath_)
+    {
+        /**
+         * 连接对象在 IO 线程创建，使用该线程缓存的内存块
+         * 任务执行时 TcpServer 可能已经开始析构，所以只持有选项和 LoopState 的弱引用，不访问 this
+         */
+        std::weak_ptr<LoopState> weakState(loopStates_.find(ioLoop)->second);
+        std::shared_ptr<const ConnectionOptions> options = options_;
+        ioLoop->runInLoop([weakState, options, ioLoop, sockfd, peerAddr]() {
+            std::shared_ptr<LoopState> state = weakState.lock();
+            if (!state)
+            {
+                ::close(sockfd);
+                return;
+            }
+            establishInLoop(state, createConnection(*options, ioLoop, sockfd, peerAddr, std::string()));
+        });
+        return;
+    }
+    TcpConnectionPtr conn = createConnection(ioLoop, sockfd, peerAddr);
+    if (!loopStates_.empty())
+    {
+        // 登记和关闭都在 IO 线程完成
+        ioLoop->runInLoop(
+            std::bind(&TcpServer::establishInLoop, loopStates_.find(ioLoop)->second, conn));
+        return;
+    }
+    connections_[conn->name()] = conn;
+    numConnections_.fetch_add(1, std::memory_order_relaxed);
 
     // 设置了如何关闭连接的回调
     conn->setCloseCallback(
@@ -112,6 +293,185 @@ void TcpServer::newConnection(int sockfd, const InetAddress &peerAddr)
         std::bind(&TcpConnection::connectEstablished, conn));
 }
 
+void TcpServer::newConnectionInLoop(EventLoop *ioLoop, const std::weak_ptr<LoopState> &state,
+                                    int sockfd, const InetAddress &peerAddr)
+{
+    if (!admitConnection(ioLoop, sockfd))
+    {
+        return;
+    }
+    // 连接在本线程建立和关闭，全程不经过 mainLoop
+    establishInLoop(state.lock(), createConnection(ioLoop, sockfd, peerAddr));
+}
+
+void TcpServer::establishInLoop(const std::shared_ptr<LoopState> &state, const TcpConnectionPtr &conn)
+{
+    conn->setId(state->registry.add(conn), state->namePrefix);
+    state->numConnections.fetch_add(1, std::memory_order_relaxed);
+    if (state->logConnections)
+    {
+        LOG_INFO << "TcpServer::newConnection - new connection [" << conn->name().c_str() << "] from " << conn->peerAddress().toIpPort().c_str();
+    }
+    // 关闭回调只持有 LoopState 的弱引用，不依赖 TcpServer 的生命期
+    conn->setCloseCallback(
+        std::bind(&TcpServer::removeLoopConnection, std::weak_ptr<LoopState>(state), std::placeholders::_1));
+    conn->connectEstablished();
+}
+
+void TcpServer::removeLoopConnection(const std::weak_ptr<LoopState> &state, const TcpConnectionPtr &conn)
+{
+    std::shared_ptr<LoopState> loopState = state.lock();
+    if (loopState && loopState->registry.remove(conn->id()))
+    {
+        loopState->numConnections.fetch_sub(1, std::memory_order_relaxed);
+    }
+    EventLoop *ioLoop = conn->getLoop();
+    ioLoop->addConnections(-1);
+    ioLoop->queueInLoop(
+        std::bind(&TcpConnection::connectDestroyed, conn));
+}
+
+int TcpServer::numConnections() const
+{
+    int total = numConnections_.load(std::memory_order_relaxed);
+    for (const auto &item : loopStates_)
+    {
+        total += item.second->numConnections.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+int64_t TcpServer::bytesReceived() const
+{
+    int64_t total = 0;
+    for (const auto &item : traffic_)
+    {
+        total += item.second->bytesIn.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+int64_t TcpServer::bytesSent() const
+{
+    int64_t total = 0;
+    for (const auto &item : traffic_)
+    {
+        total += item.second->bytesOut.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+void TcpServer::writeMetrics(MetricsWriter *writer) const
+{
+    std::string labels = MetricsWriter::label("server", name_);
+    writer->family("tcp_server_connections", "gauge", "Active connections.");
+    writer->sample("tcp_server_connections", labels, numConnections());
+    writer->family("tcp_server_rejected_connections_total", "counter", "Connections rejected by admission control.");
+    writer->sample("tcp_server_rejected_connections_total", labels, rejectedConnections());
+    writer->family("tcp_server_received_bytes_total", "counter", "Bytes read from connections.");
+    writer->sample("tcp_server_received_bytes_total", labels, bytesReceived());
+    writer->family("tcp_server_sent_bytes_total", "counter", "Bytes written to connections.");
+    writer->sample("tcp_server_sent_bytes_total", labels, bytesSent());
+}
+
+bool TcpServer::admitConnection(EventLoop *ioLoop, int sockfd)
+{
+    if ((maxConnections_ > 0 && numConnections() >= maxConnections_)
+        || (maxConnectionsPerLoop_ > 0 && ioLoop->numConnections() >= maxConnectionsPerLoop_))
+    {
+        // 过载时直接关闭，对端立即知道被拒绝，不占用 IO 线程和内存
+        rejectedConnections_.fetch_add(1, std::memory_order_relaxed);
+        LOG_WARN << "TcpServer [" << name_.c_str() << "] - too many connections, reject fd " << sockfd;
+        ::close(sockfd);
+        return false;
+    }
+    return true;
+}
+
+TcpConnectionPtr TcpServer::createConnection(EventLoop *ioLoop, int sockfd, const InetAddress &peerAddr)
+{
+    // 使用登记表时名字由 id 按需生成（见 establishInLoop）
+    std::string connName;
+    if (loopStates_.empty())
+    {
+        // 提示信息
+        char buf[64] = {0};
+        // 目前只在mainloop中执行，原子自增让 createConnection 不依赖调用线程
+        snprintf(buf, sizeof buf, "-%s#%d", ipPort_.c_str(), nextConnId_.fetch_add(1, std::memory_order_relaxed));
+        // 新连接名字
+        connName = name_ + buf;
+
+        if (connectionLogging_)
+        {
+            LOG_INFO << "TcpServer::newConnection [" << name_.c_str() << "] - new connection [" << connName.c_str() << "] from " << peerAddr.toIpPort().c_str();
+        }
+    }
+    return createConnection(*options_, ioLoop, sockfd, peerAddr, connName);
+}
+
+TcpConnectionPtr TcpServer::createConnection(const ConnectionOptions &options, EventLoop *ioLoop, int sockfd,
+                                             const InetAddress &peerAddr, const std::string &connName)
+{
+    ioLoop->addConnections(1);
+    TcpConnectionPtr conn;
+    if (options.shortLivedFastPath)
+    {
+        // 一次分配，内存块在本 IO 线程复用；本端地址按需获取
+        conn = std::allocate_shared<TcpConnection>(ConnectionAllocator<TcpConnection>(),
+                                                   ioLoop, sockfd, peerAddr, options.logging);
+    }
+    else
+    {
+        // 通过sockfd获取其绑定的本机的ip地址和端口信息
+        sockaddr_in local;
+        ::memset(&local, 0, sizeof(local));
+        socklen_t addrlen = sizeof(local);
+        if(::getsockname(sockfd, (sockaddr *)&local, &addrlen) < 0)
+        {
+            LOG_ERROR << "sockets::getLocalAddr() failed";
+        }
+
+        InetAddress localAddr(local);
+        conn = std::make_shared<TcpConnection>(ioLoop,
+                                               connName,
+                                               sockfd,
+                                               localAddr,
+                                               peerAddr);
+    }
+    if (options.bufferMode != Buffer::kContiguous)
+    {
+        conn->setBufferMode(options.bufferMode);
+    }
+    if (options.edgeTriggered)
+    {
+        conn->setEdgeTriggered(true);
+        conn->setDrainBudget(options.drainBudgetBytes, options.drainBudgetIterations);
+    }
+    if (options.writeCoalescing)
+    {
+        conn->setWriteCoalescing(true, options.corkOnFlush);
+    }
+    if (options.socketBusyPollUs > 0)
+    {
+        conn->setSocketBusyPoll(options.socketBusyPollUs);
+    }
+    if (options.flowHighWaterMark > 0)
+    {
+        conn->setFlowControl(options.flowHighWaterMark, options.flowLowWaterMark);
+    }
+    if (!options.idleWheels.empty())
+    {
+        // start 之后只读，多个 IO 线程同时查找是安全的
+        conn->setIdleWheel(options.idleWheels.find(ioLoop)->second);
+    }
+    conn->setTrafficCounters(options.traffic.find(ioLoop)->second);
+    // 下面的回调都是用户设置给TcpServer => TcpConnection的，至于Channel绑定的则是TcpConnection设置的四个，handleRead,handleWrite... 这下面的回调用于handlexxx函数中
+    conn->setConnectionCallback(options.connectionCallback);
+    conn->setMessageCallback(options.messageCallback);
+    conn->setWriteCompleteCallback(options.writeCompleteCallback);
+    return conn;
+}
+
 void TcpServer::removeConnection(const TcpConnectionPtr &conn)
 {
     loop_->runInLoop(
@@ -120,10 +480,15 @@ void TcpServer::removeConnection(const TcpConnectionPtr &conn)
 
 void TcpServer::removeConnectionInLoop(const TcpConnectionPtr &conn)
 {
-    LOG_INFO << "TcpServer::removeConnectionInLoop [" << name_.c_str() << "] - connection " << conn->name().c_str();
+    if (connectionLogging_)
+    {
+        LOG_INFO << "TcpServer::removeConnectionInLoop [" << name_.c_str() << "] - connection " << conn->name().c_str();
+    }
 
     connections_.erase(conn->name());
     EventLoop *ioLoop = conn->getLoop();
+    ioLoop->addConnections(-1);
+    numConnections_.fetch_sub(1, std::memory_order_relaxed);
     ioLoop->queueInLoop(
         std::bind(&TcpConnection::connectDestroyed, conn));
 }
\ No newline at end of file
@@ -5,7 +5,10 @@
 #include <string>
 #include <memory>
 #include <unordered_map>
+#include <vector>
 #include <atomic>
+#include <mutex>
+#include <condition_variable>
 
 #include "EventLoop.h"
 #include "EventLoopThreadPool.h"
@@ -14,6 +17,8 @@
 #include "noncopyable.h"
 #include "Callback.h"
 #include "TcpConnection.h"
+#include "IdleWheel.h"
+#include "ConnectionRegistry.h"
 
 /**
  * 我们用户编写的时候就是使用的TcpServer
@@ -34,9 +39,13 @@ public:
                 const InetAddress &ListenAddr,
                 const std::string &nameArg,
                 Option option = kNoReusePort);
+    /**
+     * 在 baseLoop 线程或 baseLoop 已经停止之后析构；析构时 subLoop 必须还在运行
+     * （它们属于本对象的线程池，只有在析构结束后才会退出）
+     */
     ~TcpServer();
 
-    // 设置回调函数(用户自定义的函数传入)
+    // 设置回调函数(用户自定义的函数传入)，需在 start 之前设置，start 时复制给新连接使用
     void setThreadInitCallback(const ThreadInitCallback &cb) { threadInitCallback_ = cb; }
     void setConnectionCallback(const ConnectionCallback &cb) { connectionCallback_ = cb; }
     void setMessageCallback(const MessageCallback &cb) { messageCallback_ = cb; }
@@ -45,6 +54,125 @@ public:
     // 设置底层subLoop的个数
     void setThreadNum(int numThreads);
 
+    /**
+     * subLoop 使用的 IO 复用后端，需在 start 之前设置
+     * mainLoop 由用户创建，需要时在构造 EventLoop 时传入同样的后端
+     */
+    void setPollerBackend(PollerBackend backend);
+
+    /**
+     * subLoop 线程的 CPU 绑定策略（见 CpuAffinity），需在 start 之前设置
+     * steerByIncomingCpu 为 true 时，新连接按 SO_INCOMING_CPU（处理该连接软中断的 CPU）
+     * 交给绑定在同一 CPU 上的 subLoop，没有对应的 subLoop 时仍按轮询分配
+     */
+    void setCpuAffinity(const CpuAffinity &affinity, bool steerByIncomingCpu = false)
+    {
+        threadPool_->setCpuAffinity(affinity);
+        steerByIncomingCpu_ = steerByIncomingCpu;
+    }
+
+    /**
+     * 每个 IO 线程各自持有一个 SO_REUSEPORT 监听套接字并在本线程 accept，
+     * 由内核在监听套接字之间分配连接，新连接不再经过 mainLoop 转交，需在 start 之前设置
+     * cpuSteering 为 true 时挂 CBPF 程序，让收到 SYN 的 CPU 上绑定的 loop 接受该连接（见 setCpuAffinity）
+     * 此模式下分配策略和 steerByIncomingCpu 不起作用，连接总是登记在 IO 线程的登记表中（见 setShardedRegistry）
+     */
+    void setAcceptPerLoop(bool on, bool cpuSteering = false)
+    {
+        acceptPerLoop_ = on;
+        acceptCpuSteering_ = cpuSteering;
+    }
+
+    /**
+     * 准入控制：服务器总连接数或所选 IO 线程的连接数达到上限时，新连接 accept 后立即关闭
+     * 0 表示不限制；多个 IO 线程各自 accept 时上限是近似的
+     */
+    void setMaxConnections(int maxTotal, int maxPerLoop = 0)
+    {
+        maxConnections_ = maxTotal;
+        maxConnectionsPerLoop_ = maxPerLoop;
+    }
+    // 每次可读事件最多 accept 的连接数（见 Acceptor::setAcceptBatch），需在 start 之前设置
+    void setAcceptBatch(int n) { acceptBatch_ = n; }
+
+    // 当前连接数，start 之后可在任意线程调用
+    int numConnections() const;
+    // 因准入控制被拒绝的连接数
+    int64_t rejectedConnections() const { return rejectedConnections_.load(std::memory_order_relaxed); }
+    // 所有连接累计收发的字节数，start 之后可在任意线程调用
+    int64_t bytesReceived() const;
+    int64_t bytesSent() const;
+    // 处理连接的 IO 线程（没有 subLoop 时就是 mainLoop），start 之后可用
+    std::vector<EventLoop *> ioLoops() const { return threadPool_->getAllLoops(); }
+    // 按 Prometheus 文本格式输出连接数和收发字节数，以 server 标签区分
+    void writeMetrics(MetricsWriter *writer) const;
+
+    /**
+     * 连接登记在所属 IO 线程的 ConnectionRegistry 中，以 64 位 id 标识，名字在第一次调用 name() 时才生成；
+     * 连接的登记、注销和销毁都在 IO 线程完成，关闭连接不再经过 mainLoop。需在 start 之前设置
+     */
+    void setShardedRegistry(bool on) { shardedRegistry_ = on; }
+
+    /**
+     * 短连接（建立、一问一答、关闭）快速路径，需在 start 之前设置：
+     * 1. 连接使用各 IO 线程的登记表（同 setShardedRegistry），连接对象在 IO 线程创建
+     * 2. 连接对象和控制块一次分配，内存块在 IO 线程内缓存复用（见 ConnectionAllocator）
+     * 3. 不调用 getsockname，本端地址在第一次调用 localAddress() 时才获取
+     * 4. 关闭连接的建立 / 销毁日志，需要时在之后调用 setConnectionLogging(true)
+     */
+    void setShortLivedFastPath(bool on)
+    {
+        shortLivedFastPath_ = on;
+        connectionLogging_ = !on;
+    }
+    // 连接建立和销毁时是否打印 INFO 日志，默认打印
+    void setConnectionLogging(bool on) { connectionLogging_ = on; }
+
+    // 新连接分配到 subLoop 的策略（见 EventLoopThreadPool::DispatchPolicy），需在 start 之前设置
+    void setDispatchPolicy(EventLoopThreadPool::DispatchPolicy policy) { threadPool_->setDispatchPolicy(policy); }
+    void setDispatchCallback(const EventLoopThreadPool::DispatchCallback &cb) { threadPool_->setDispatchCallback(cb); }
+
+    // 新连接的缓冲区模式，大响应场景可以使用 Buffer::kSegmented
+    void setBufferMode(Buffer::Mode mode) { bufferMode_ = mode; }
+
+    // 新连接以边缘触发方式注册，每次事件读写的上限见 TcpConnection::setDrainBudget
+    void setEdgeTriggered(bool on) { edgeTriggered_ = on; }
+    void setDrainBudget(size_t maxBytes, int maxIterations)
+    {
+        drainBudgetBytes_ = maxBytes;
+        drainBudgetIterations_ = maxIterations;
+    }
+
+    // 新连接使用合并写，见 TcpConnection::setWriteCoalescing
+    void setWriteCoalescing(bool on, bool useCork = false)
+    {
+        writeCoalescing_ = on;
+        corkOnFlush_ = useCork;
+    }
+
+    /**
+     * IO 线程的忙轮询窗口（见 EventLoop::setBusyPoll），socketBusyPollUs > 0 时
+     * 同时给新连接设置 SO_BUSY_POLL。需在 start 之前设置
+     */
+    void setBusyPoll(double spinSeconds, int socketBusyPollUs = 0)
+    {
+        busyPollSeconds_ = spinSeconds;
+        socketBusyPollUs_ = socketBusyPollUs;
+    }
+
+    // 新连接开启自动流控，见 TcpConnection::setFlowControl
+    void setFlowControl(size_t highWaterMark, size_t lowWaterMark)
+    {
+        flowHighWaterMark_ = highWaterMark;
+        flowLowWaterMark_ = lowWaterMark;
+    }
+
+    /**
+     * 空闲连接回收：超过 seconds 秒没有读写的连接被强制关闭，0 表示关闭此功能
+     * 每个 IO 线程一个 IdleWheel，需在 start 之前设置
+     */
+    void setIdleTimeout(double seconds) { idleTimeoutSeconds_ = seconds; }
+
     // 开启服务器监听
     void start();
     
@@ -55,24 +183,95 @@ public:
     const std::string ipPort() { return ipPort_; }
 
 private:
-    void newConnection(int sockfd, const InetAddress &peerAddr);
-    void removeConnection(const TcpConnectionPtr &conn);
-    void removeConnectionInLoop(const TcpConnectionPtr &conn);
-
     /**
      * key:     std::string
      * value:   std::shared_ptr<TcpConnection> 
      */
     using ConnectionMap = std::unordered_map<std::string, TcpConnectionPtr>;
 
+    // start 之后只读，newConnection 按 ioLoop 取对应的轮子
+    using IdleWheelMap = std::unordered_map<EventLoop*, std::shared_ptr<IdleWheel>>;
+    // 各 IO 线程的收发计数，start 时建立，之后只读
+    using TrafficMap = std::unordered_map<EventLoop*, std::shared_ptr<TrafficCounters>>;
+
+    // 新连接的选项和用户回调，start 时从 TcpServer 复制一份，之后只读；IO 线程建立连接时只依赖它，不访问 TcpServer
+    struct ConnectionOptions
+    {
+        Buffer::Mode bufferMode;
+        bool edgeTriggered;
+        size_t drainBudgetBytes;
+        int drainBudgetIterations;
+        bool writeCoalescing;
+        bool corkOnFlush;
+        int socketBusyPollUs;
+        size_t flowHighWaterMark;
+        size_t flowLowWaterMark;
+        bool shortLivedFastPath;
+        bool logging;
+        IdleWheelMap idleWheels;
+        TrafficMap traffic;
+        ConnectionCallback connectionCallback;
+        MessageCallback messageCallback;
+        WriteCompleteCallback writeCompleteCallback;
+    };
+
+    // setShardedRegistry / setAcceptPerLoop 模式下一个 IO 线程的连接和监听套接字，只在该 loop 线程访问
+    struct LoopState
+    {
+        LoopState(uint16_t shard, const std::shared_ptr<const std::string> &prefix, bool logging)
+            : registry(shard), namePrefix(prefix), logConnections(logging), numConnections(0), tornDown(false) {}
+
+        std::unique_ptr<Acceptor> acceptor; // 只有 setAcceptPerLoop 模式才有
+        ConnectionRegistry registry;
+        std::shared_ptr<const std::string> namePrefix;
+        const bool logConnections;
+        std::atomic_int numConnections;     // registry 的大小，供其他线程读取
+        std::atomic_bool tornDown;          // 析构时是否已经销毁，保证只销毁一次
+    };
+
+    // 析构时等待各 loop 销毁 LoopState
+    struct TeardownLatch
+    {
+        explicit TeardownLatch(size_t count) : remaining(count) {}
+
+        std::mutex mutex;
+        std::condition_variable cond;
+        size_t remaining;
+    };
+
+    void newConnection(int sockfd, const InetAddress &peerAddr);
+    void removeConnection(const TcpConnectionPtr &conn);
+    void removeConnectionInLoop(const TcpConnectionPtr &conn);
+
+    // setAcceptPerLoop 模式：ioLoop 自己 accept 到的连接
+    void newConnectionInLoop(EventLoop *ioLoop, const std::weak_ptr<LoopState> &state,
+                             int sockfd, const InetAddress &peerAddr);
+    // 在 IO 线程登记并建立连接 / 注销连接
+    static void establishInLoop(const std::shared_ptr<LoopState> &state, const TcpConnectionPtr &conn);
+    static void removeLoopConnection(const std::weak_ptr<LoopState> &state, const TcpConnectionPtr &conn);
+    void startLoopStates();
+    // 销毁一个 loop 的监听套接字和连接，在该 loop 线程调用，或在它停止之后由析构线程调用
+    static void teardownLoopState(const std::shared_ptr<LoopState> &state,
+                                  const std::shared_ptr<TeardownLatch> &latch);
+
+    // 准入控制，不通过时关闭 sockfd 并返回 false
+    bool admitConnection(EventLoop *ioLoop, int sockfd);
+    // 创建连接并设置选项和用户回调，不包括关闭回调；不使用登记表时在这里生成连接名
+    TcpConnectionPtr createConnection(EventLoop *ioLoop, int sockfd, const InetAddress &peerAddr);
+    static TcpConnectionPtr createConnection(const ConnectionOptions &options, EventLoop *ioLoop, int sockfd,
+                                             const InetAddress &peerAddr, const std::string &connName);
+
     
     EventLoop *loop_;                    // 用户定义的baseLoop
+    const InetAddress listenAddr_;
     const std::string ipPort_;           // 传入的IP地址和端口号
     const std::string name_;             // TcpServer名字
     std::unique_ptr<Acceptor> acceptor_; // Acceptor对象负责监视
     
     std::shared_ptr<EventLoopThreadPool> threadPool_; // 线程池
 
+    std::shared_ptr<const ConnectionOptions> options_;  // start 时建立
+
     ConnectionCallback  connectionCallback_;        // 有新连接时的回调函数
     MessageCallback messageCallback_;               // 有读写消息时的回调函数
     WriteCompleteCallback writeCompleteCallback_;   // 消息发送完成以后的回调函数
@@ -80,8 +279,35 @@ private:
     ThreadInitCallback threadInitCallback_;  // loop线程初始化的回调函数
     std::atomic_int started_;                // TcpServer
 
-    int nextConnId_;            // 连接索引
+    std::atomic_int nextConnId_;    // 连接索引
     ConnectionMap connections_; // 保存所有的连接
+
+    Buffer::Mode bufferMode_;   // 新连接使用的缓冲区模式
+    bool edgeTriggered_;        // 新连接是否使用边缘触发
+    size_t drainBudgetBytes_;
+    int drainBudgetIterations_;
+    bool writeCoalescing_;      // 新连接是否合并写
+    bool corkOnFlush_;
+    double busyPollSeconds_;    // IO 线程忙轮询窗口，0 表示关闭
+    int socketBusyPollUs_;      // 新连接的 SO_BUSY_POLL
+    size_t flowHighWaterMark_;  // 为 0 表示不开启流控
+    size_t flowLowWaterMark_;
+    double idleTimeoutSeconds_; // 为 0 表示不回收空闲连接
+    IdleWheelMap idleWheels_;
+    TrafficMap traffic_;
+    bool steerByIncomingCpu_;   // 是否按 SO_INCOMING_CPU 选择 subLoop
+    bool acceptPerLoop_;        // 是否每个 IO 线程各自 accept
+    bool acceptCpuSteering_;
+    bool shardedRegistry_;      // 是否使用各 IO 线程的连接登记表
+    bool shortLivedFastPath_;
+    bool connectionLogging_;
+    // start 之后只读
+    std::unordered_map<EventLoop*, std::shared_ptr<LoopState>> loopStates_;
+    int acceptBatch_;
+    int maxConnections_;        // 为 0 表示不限制
+    int maxConnectionsPerLoop_;
+    std::atomic_int numConnections_;    // connections_ 中的连接数，登记在 IO 线程中的记在 LoopState 中
+    std::atomic<int64_t> rejectedConnections_;
 };
 
 #endif // TCP_SERVER_H
\ No newline at end of file
@@ -0,0 +1,257 @@
+#include "UpstreamPool.h"
+#include "TcpClient.h"
+#include "Connector.h"
+#include "EventLoop.h"
+#include "LoopClock.h"
+#include "WeakCallback.h"
+#include "Logging.h"
+
+const double UpstreamPool::kDefaultIdleTimeout = 60.0;
+const double UpstreamPool::kDefaultAcquireTimeout = 5.0;
+
+namespace
+{
+    // 空闲连接和等待者的清理间隔（秒）
+    const double kSweepInterval = 1.0;
+
+    Timestamp monotonicNow()
+    {
+        return Timestamp(LoopClock::monotonic());
+    }
+}
+
+UpstreamPool::UpstreamPool(EventLoop *loop, const InetAddress &serverAddr, const std::string &nameArg)
+    : loop_(loop)
+    , serverAddr_(serverAddr)
+    , name_(nameArg)
+    , maxConnections_(kDefaultMaxConnections)
+    , idleTimeout_(kDefaultIdleTimeout)
+    , acquireTimeout_(kDefaultAcquireTimeout)
+    , connectTimeout_(Connector::kDefaultConnectTimeout)
+    , nextClientId_(1)
+    , connecting_(0)
+{
+}
+
+UpstreamPool::~UpstreamPool()
+{
+    if (sweepTimer_.valid())
+    {
+        loop_->cancel(sweepTimer_);
+    }
+    // TcpClient 析构时会关闭空闲的连接；借出的连接随使用方释放
+}
+
+void UpstreamPool::acquire(AcquireCallback cb)
+{
+    if (!sweepTimer_.valid())
+    {
+        sweepTimer_ = loop_->runEvery(kSweepInterval,
+                                      makeWeakCallback(shared_from_this(), &UpstreamPool::onSweep));
+    }
+    while (!idle_.empty())
+    {
+        TcpConnectionPtr conn = std::move(idle_.back().conn);
+        idle_.pop_back();
+        if (conn->connected())
+        {
+            cb(conn);
+            return;
+        }
+    }
+    waiters_.push_back(Waiter{std::move(cb), addTime(monotonicNow(), acquireTimeout_)});
+    // 正在建立的连接已经够分给所有等待者时不再新建
+    if (static_cast<int>(clients_.size()) < maxConnections_ &&
+        connecting_ < static_cast<int>(waiters_.size()))
+    {
+        newClient();
+    }
+}
+
+void UpstreamPool::release(const TcpConnectionPtr &conn)
+{
+    // 通常是在该连接的 MessageCallback 中归还，此时不能替换正在执行的回调，推迟到本轮末尾
+    std::weak_ptr<UpstreamPool> weakSelf(shared_from_this());
+    loop_->queueInLoop([weakSelf, conn]() {
+        std::shared_ptr<UpstreamPool> self(weakSelf.lock());
+        if (self)
+        {
+            self->releaseInLoop(conn);
+        }
+    });
+}
+
+void UpstreamPool::releaseInLoop(const TcpConnectionPtr &conn)
+{
+    if (!conn->connected())
+    {
+        return;
+    }
+    std::weak_ptr<UpstreamPool> weakSelf(shared_from_this());
+    conn->setMessageCallback([weakSelf](const TcpConnectionPtr &c, Buffer *buf, Timestamp t) {
+        std::shared_ptr<UpstreamPool> self(weakSelf.lock());
+        if (self)
+        {
+            self->onIdleMessage(c, buf, t);
+        }
+    });
+    handOut(conn);
+}
+
+void UpstreamPool::newClient()
+{
+    char buf[32];
+    snprintf(buf, sizeof buf, "#%d", nextClientId_);
+    ++nextClientId_;
+    std::shared_ptr<TcpClient> client(new TcpClient(loop_, serverAddr_, name_ + buf));
+    client->setConnectTimeout(connectTimeout_);
+    std::weak_ptr<UpstreamPool> weakSelf(shared_from_this());
+    TcpClient *rawClient = client.get();
+    client->setConnectFailedCallback([weakSelf, rawClient]() {
+        std::shared_ptr<UpstreamPool> self(weakSelf.lock());
+        if (self)
+        {
+            self->onConnectFailed(rawClient);
+        }
+    });
+    client->setConnectionCallback([weakSelf, rawClient](const TcpConnectionPtr &conn) {
+        std::shared_ptr<UpstreamPool> self(weakSelf.lock());
+        if (self)
+        {
+            self->onConnection(rawClient, conn);
+        }
+    });
+    client->setMessageCallback([weakSelf](const TcpConnectionPtr &c, Buffer *b, Timestamp t) {
+        std::shared_ptr<UpstreamPool> self(weakSelf.lock());
+        if (self)
+        {
+            self->onIdleMessage(c, b, t);
+        }
+    });
+    clients_[rawClient] = client;
+    ++connecting_;
+    client->connect();
+}
+
+void UpstreamPool::onConnection(TcpClient *client, const TcpConnectionPtr &conn)
+{
+    if (conn->connected())
+    {
+        --connecting_;
+        handOut(conn);
+        return;
+    }
+    // 连接断开（空闲时被对端关闭、被清理或使用方关闭），TcpClient 不再有用
+    removeIdle(conn);
+    auto it = clients_.find(client);
+    if (it != clients_.end())
+    {
+        std::shared_ptr<TcpClient> dead = std::move(it->second);
+        clients_.erase(it);
+        // 正处在该 TcpClient 的回调中，推迟到本轮末尾销毁
+        loop_->queueInLoop([dead]() {});
+    }
+    if (!waiters_.empty() && static_cast<int>(clients_.size()) < maxConnections_ &&
+        connecting_ < static_cast<int>(waiters_.size()))
+    {
+        newClient();
+    }
+}
+
+void UpstreamPool::onConnectFailed(TcpClient *client)
+{
+    auto it = clients_.find(client);
+    if (it == clients_.end())
+    {
+        return;
+    }
+    // 不让 Connector 退避重试，否则等待者要到 acquireTimeout 才能知道上游连不上
+    it->second->stop();
+    // 正处在该 TcpClient 的 Connector 回调中，推迟到本轮末尾销毁
+    std::shared_ptr<TcpClient> dead = std::move(it->second);
+    loop_->queueInLoop([dead]() {});
+    clients_.erase(it);
+    --connecting_;
+    // 每个新建的连接对应一个等待者，连接失败就让最早的等待者失败
+    if (!waiters_.empty())
+    {
+        AcquireCallback cb = std::move(waiters_.front().cb);
+        waiters_.pop_front();
+        LOG_WARN << "UpstreamPool[" << name_.c_str() << "] - connect to "
+                 << serverAddr_.toIpPort().c_str() << " failed";
+        cb(TcpConnectionPtr());
+    }
+}
+
+void UpstreamPool::onIdleMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+{
+    LOG_WARN << "UpstreamPool[" << name_.c_str() << "] - unexpected " << static_cast<int>(buf->readableBytes())
+             << " bytes on idle connection " << conn->name().c_str();
+    buf->retrieveAll();
+    removeIdle(conn);
+    conn->forceClose();
+}
+
+void UpstreamPool::handOut(const TcpConnectionPtr &conn)
+{
+    if (!waiters_.empty())
+    {
+        AcquireCallback cb = std::move(waiters_.front().cb);
+        waiters_.pop_front();
+        cb(conn);
+        return;
+    }
+    idle_.push_back(IdleConnection{conn, monotonicNow()});
+}
+
+void UpstreamPool::removeIdle(const TcpConnectionPtr &conn)
+{
+    for (auto it = idle_.begin(); it != idle_.end(); ++it)
+    {
+        if (it->conn == conn)
+        {
+            idle_.erase(it);
+            return;
+        }
+    }
+}
+
+void UpstreamPool::onSweep()
+{
+    Timestamp now = monotonicNow();
+    // 头部是最早归还的，遇到没超时的即可停止
+    while (!idle_.empty() && timeDifference(now, idle_.front().since) >= idleTimeout_)
+    {
+        TcpConnectionPtr conn = std::move(idle_.front().conn);
+        idle_.pop_front();
+        conn->forceClose();
+    }
+    // 等待者按入队顺序排列，截止时间也是递增的
+    while (!waiters_.empty() && waiters_.front().deadline < now)
+    {
+        AcquireCallback cb = std::move(waiters_.front().cb);
+        waiters_.pop_front();
+        LOG_WARN << "UpstreamPool[" << name_.c_str() << "] - acquire timeout";
+        cb(TcpConnectionPtr());
+    }
+    if (waiters_.empty() && connecting_ > 0)
+    {
+        // 没有人等待了，放弃还在建立中的连接（连接超时为 0 时可能很久才有结果）
+        for (auto it = clients_.begin(); it != clients_.end();)
+        {
+            if (!it->second->connection())
+            {
+                it->second->stop();
+                // 定时器回调可能正处在活跃 channel 的分发中，TcpClient 及其 channel 推迟到本轮末尾销毁
+                std::shared_ptr<TcpClient> dead = std::move(it->second);
+                loop_->queueInLoop([dead]() {});
+                it = clients_.erase(it);
+                --connecting_;
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+}
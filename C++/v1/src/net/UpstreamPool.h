@@ -0,0 +1,103 @@
+#ifndef UPSTREAM_POOL_H
+#define UPSTREAM_POOL_H
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "noncopyable.h"
+#include "Callback.h"
+#include "InetAddress.h"
+#include "Timestamp.h"
+#include "TimerId.h"
+
+class EventLoop;
+class TcpClient;
+
+/**
+ * 到同一个上游地址的长连接池，每个 EventLoop 一个，只在所属 loop 线程使用，不需要加锁
+ *
+ * 1. acquire 优先复用最近归还的空闲连接（LIFO，连接更可能还是热的），
+ *    没有空闲连接且未达到上限时新建连接，否则排队等待归还
+ * 2. 借出期间由使用方设置 MessageCallback，release 时恢复成池的回调；
+ *    空闲连接上收到数据说明协议状态已乱，直接关闭
+ * 3. 空闲超过 idleTimeout 的连接、等待超过 acquireTimeout 的请求由每秒一次的定时器清理，
+ *    等待超时的请求以空指针回调
+ * 4. 新建连接失败（包括连接超时）时不重试，丢弃该连接并以空指针回调最早的等待者
+ *
+ * 需用 std::make_shared 创建，回调只持有弱引用
+ */
+class UpstreamPool : noncopyable, public std::enable_shared_from_this<UpstreamPool>
+{
+public:
+    // 连接建立失败或等待超时时参数为空
+    using AcquireCallback = std::function<void(const TcpConnectionPtr &)>;
+
+    static const int kDefaultMaxConnections = 64;
+    static const double kDefaultIdleTimeout;        // 秒
+    static const double kDefaultAcquireTimeout;
+
+    UpstreamPool(EventLoop *loop, const InetAddress &serverAddr, const std::string &nameArg);
+    ~UpstreamPool();
+
+    // 以下需在第一次 acquire 之前设置
+    void setMaxConnections(int n) { maxConnections_ = n; }
+    void setIdleTimeout(double seconds) { idleTimeout_ = seconds; }
+    void setAcquireTimeout(double seconds) { acquireTimeout_ = seconds; }
+    // 与 Connector 一致：默认 Connector::kDefaultConnectTimeout，0 表示不限制
+    void setConnectTimeout(double seconds) { connectTimeout_ = seconds; }
+
+    // 以下只能在 loop 线程调用
+    void acquire(AcquireCallback cb);
+    // 归还借出的连接，可以在该连接的回调中调用；已经断开的连接直接丢弃
+    void release(const TcpConnectionPtr &conn);
+
+    EventLoop* getLoop() const { return loop_; }
+    const std::string& name() const { return name_; }
+    // 已建立和正在建立的连接数
+    size_t numConnections() const { return clients_.size(); }
+    size_t numIdle() const { return idle_.size(); }
+    size_t numWaiters() const { return waiters_.size(); }
+
+private:
+    struct IdleConnection
+    {
+        TcpConnectionPtr conn;
+        Timestamp since;        // 归还的时刻（单调时间，见 LoopClock）
+    };
+    struct Waiter
+    {
+        AcquireCallback cb;
+        Timestamp deadline;
+    };
+
+    void releaseInLoop(const TcpConnectionPtr &conn);
+    void newClient();
+    void onConnection(TcpClient *client, const TcpConnectionPtr &conn);
+    void onConnectFailed(TcpClient *client);
+    void onIdleMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp);
+    // 把可用的连接交给等待者，没有等待者时放入空闲列表
+    void handOut(const TcpConnectionPtr &conn);
+    void removeIdle(const TcpConnectionPtr &conn);
+    void onSweep();
+
+    EventLoop *loop_;
+    const InetAddress serverAddr_;
+    const std::string name_;
+    int maxConnections_;
+    double idleTimeout_;
+    double acquireTimeout_;
+    double connectTimeout_;
+    int nextClientId_;
+    TimerId sweepTimer_;
+
+    // TcpClient 可能在自己的回调中被移除，用 shared_ptr 以便推迟到本轮末尾销毁
+    std::unordered_map<TcpClient*, std::shared_ptr<TcpClient>> clients_;
+    std::deque<IdleConnection> idle_;   // 尾部是最近归还的
+    std::deque<Waiter> waiters_;
+    int connecting_;                    // 正在建立的连接数
+};
+
+#endif // UPSTREAM_POOL_H
@@ -1,17 +1,35 @@
 #include "Poller.h"
 #include "EPollPoller.h"
+#include "IoUringPoller.h"
+#include "EventLoop.h"
 
 #include <stdlib.h>
 // 获取默认的Poller实现方式
-Poller* Poller::newDefaultPoller(EventLoop *loop)
+Poller* Poller::newDefaultPoller(EventLoop *loop, PollerBackend backend)
 {
+    if (backend == PollerBackend::kDefault)
+    {
+        backend = ::getenv("MUDUO_USE_URING") ? PollerBackend::kIoUring : PollerBackend::kEpoll;
+    }
+
     if (::getenv("MUDUO_USE_POLL"))
     {
         return nullptr; // 生成poll实例
     }
+    else if (backend == PollerBackend::kIoUring)
+    {
+        IoUringPoller *poller = new IoUringPoller(loop); // 生成io_uring实例
+        if (poller->valid())
+        {
+            return poller;
+        }
+        // 内核不支持或被禁用时退回epoll
+        LOG_WARN << "io_uring unavailable, fall back to epoll";
+        delete poller;
+        return new EPollPoller(loop);
+    }
     else
     {
         return new EPollPoller(loop); // 生成epoll实例
     }
 }
-
@@ -1,5 +1,7 @@
 #include "EPollPoller.h"
+#include "LoopClock.h"
 #include <string.h>
+#include <sys/syscall.h>
 
 const int kNew = -1;    // 某个channel还没添加至Poller          // channel的成员index_初始化为-1
 const int kAdded = 1;   // 某个channel已经添加至Poller
@@ -9,7 +11,8 @@ const int kDeleted = 2; // 某个channel已经从Poller删除
 EPollPoller::EPollPoller(EventLoop *loop) :
         Poller(loop), // 传给基类
         epollfd_(::epoll_create1(EPOLL_CLOEXEC)),
-        events_(kInitEventListSize)
+        events_(kInitEventListSize),
+        hasPwait2_(true)
 {
     if (epollfd_ < 0)
     {
@@ -26,17 +29,43 @@ Timestamp EPollPoller::poll(int timeoutMs, ChannelList *activeChannels)
 {
     // 高并发情况经常被调用，影响效率，使用debug模式可以手动关闭
 
-    size_t numEvents = ::epoll_wait(epollfd_, &(*events_.begin()), 
+    int numEvents = ::epoll_wait(epollfd_, &(*events_.begin()), 
                         static_cast<int>(events_.size()), timeoutMs);
-    int saveErrno = errno;
-    Timestamp now(Timestamp::now());
+    return handlePollResult(numEvents, errno, activeChannels);
+}
+
+Timestamp EPollPoller::pollMicroSeconds(int64_t timeoutUs, ChannelList *activeChannels)
+{
+#ifdef SYS_epoll_pwait2
+    if (hasPwait2_)
+    {
+        struct timespec ts;
+        ts.tv_sec = static_cast<time_t>(timeoutUs / Timestamp::kMicroSecondsPerSecond);
+        ts.tv_nsec = static_cast<long>(timeoutUs % Timestamp::kMicroSecondsPerSecond) * 1000;
+        int numEvents = static_cast<int>(::syscall(SYS_epoll_pwait2, epollfd_, &(*events_.begin()),
+                                                   static_cast<int>(events_.size()),
+                                                   timeoutUs < 0 ? nullptr : &ts, nullptr, 0));
+        if (numEvents >= 0 || errno != ENOSYS)
+        {
+            return handlePollResult(numEvents, errno, activeChannels);
+        }
+        // 内核不支持（5.11 之前），以后都使用 epoll_wait
+        hasPwait2_ = false;
+    }
+#endif
+    return Poller::pollMicroSeconds(timeoutUs, activeChannels);
+}
+
+Timestamp EPollPoller::handlePollResult(int numEvents, int saveErrno, ChannelList *activeChannels)
+{
+    Timestamp now(LoopClock::refresh());  // 每次 poll 返回刷新一次本线程的缓存时钟
 
     // 有事件产生
     if (numEvents > 0)
     {
         fillActiveChannels(numEvents, activeChannels); // 填充活跃的channels
         // 对events_进行扩容操作
-        if (numEvents == events_.size())
+        if (static_cast<size_t>(numEvents) == events_.size())
         {
             events_.resize(events_.size() * 2);
         }
@@ -76,7 +105,7 @@ void EPollPoller::updateChannel(Channel *channel)
         if (index == kNew)
         {
             int fd = channel->fd();
-            channels_[fd] = channel; 
+            channels_.insert(fd, channel);
         }
         else // index == kAdd
         {
@@ -108,10 +137,18 @@ void EPollPoller::fillActiveChannels(int numEvents, ChannelList *activeChannels)
 {
     for (int i = 0; i < numEvents; ++i)
     {
-        // void* => Channel*
-        Channel *channel = static_cast<Channel*>(events_[i].data.ptr);
+        // data.u64 = 代数 << 32 | fd，见 update()
+        uint64_t data = events_[i].data.u64;
+        int fd = static_cast<int>(data & 0xffffffff);
+        Channel *channel = channels_.find(fd);
+        uint32_t generation = static_cast<uint32_t>(data >> 32);
+        // fd 已经移除，或者关闭后被复用重新注册了，丢掉这个过期事件
+        if (channel == nullptr || channels_.generation(fd) != generation)
+        {
+            continue;
+        }
         channel->set_revents(events_[i].events);
-        activeChannels->push_back(channel);
+        activeChannels->push_back(ActiveChannel{channel, fd, generation});
     }
 }
 
@@ -139,8 +176,13 @@ void EPollPoller::update(int operation, Channel *channel)
 
     int fd = channel->fd();
     event.events = channel->events();
-    event.data.fd = fd;
-    event.data.ptr = channel;
+    if (channel->edgeTriggered() && !channel->isNoneEvent())
+    {
+        event.events |= EPOLLET;
+    }
+    // 不存 Channel 指针，存 fd 和注册时的代数，取回事件时查表并校验代数
+    event.data.u64 = static_cast<uint64_t>(channels_.generation(fd)) << 32
+                   | static_cast<uint32_t>(fd);
 
     if (::epoll_ctl(epollfd_, operation, fd, &event) < 0)
     {
@@ -23,6 +23,8 @@ public:
 
     // 重写基类Poller的抽象方法
     Timestamp poll(int timeoutMs, ChannelList *activeChannels) override;
+    // 内核支持时使用 epoll_pwait2，超时精确到微秒，否则退回毫秒
+    Timestamp pollMicroSeconds(int64_t timeoutUs, ChannelList *activeChannels) override;
     void updateChannel(Channel *channel) override;
     void removeChannel(Channel *channel) override;
 
@@ -30,6 +32,8 @@ private:
     // 默认监听事件数量
     static const int kInitEventListSize = 16; 
 
+    // 处理 epoll_wait / epoll_pwait2 的返回值
+    Timestamp handlePollResult(int numEvents, int saveErrno, ChannelList *activeChannels);
     // 填写活跃的连接
     void fillActiveChannels(int numEvents, ChannelList *activeChannels) const;
     // 更新channel通道，本质是调用了epoll_ctl
@@ -37,6 +41,7 @@ private:
 
     int epollfd_;       // epoll_create在内核创建空间返回的fd
     EventList events_;  // 用于存放epoll_wait返回的所有发生的事件的文件描述符
+    bool hasPwait2_;    // 内核是否支持 epoll_pwait2，第一次返回 ENOSYS 后置为 false
 };
 
 #endif // EPOLLPOLLER_H
\ No newline at end of file
@@ -0,0 +1,411 @@
+#include "IoUringPoller.h"
+#include "LoopClock.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+const int kNew = -1;    // 某个channel还没添加至Poller
+const int kAdded = 1;   // 某个channel已经添加至Poller
+const int kDeleted = 2; // 某个channel已经从Poller删除
+
+// 取消请求等内部操作的 user_data，poll 请求的 tag 高 32 位是非零的代数，不会与之冲突
+const uint64_t kInternalTag = 0;
+
+IoUringPoller::IoUringPoller(EventLoop *loop)
+    : Poller(loop),
+      ringfd_(-1),
+      sqRing_(MAP_FAILED),
+      sqRingSize_(0),
+      sqHead_(nullptr),
+      sqTail_(nullptr),
+      sqMask_(0),
+      sqArray_(nullptr),
+      sqes_(static_cast<struct io_uring_sqe*>(MAP_FAILED)),
+      sqesSize_(0),
+      sqFlags_(nullptr),
+      sqLocalTail_(0),
+      cqRing_(MAP_FAILED),
+      cqRingSize_(0),
+      cqHead_(nullptr),
+      cqTail_(nullptr),
+      cqMask_(0),
+      cqes_(nullptr),
+      cqOverflow_(nullptr),
+      lastOverflow_(0),
+      cqOverflowed_(false),
+      nextGeneration_(1)
+{
+    if (!setupRing())
+    {
+        teardownRing();
+    }
+}
+
+IoUringPoller::~IoUringPoller()
+{
+    teardownRing();
+}
+
+bool IoUringPoller::setupRing()
+{
+    struct io_uring_params params;
+    ::memset(&params, 0, sizeof(params));
+    // 完成事件只在本线程进入内核时处理，减少被其他线程打断（5.19 之前的内核不支持，退回默认）
+    params.flags = IORING_SETUP_COOP_TASKRUN;
+    ringfd_ = static_cast<int>(::syscall(__NR_io_uring_setup, kRingEntries, &params));
+    if (ringfd_ < 0 && errno == EINVAL)
+    {
+        ::memset(&params, 0, sizeof(params));
+        ringfd_ = static_cast<int>(::syscall(__NR_io_uring_setup, kRingEntries, &params));
+    }
+    if (ringfd_ < 0)
+    {
+        LOG_WARN << "io_uring_setup() failed:" << errno;
+        return false;
+    }
+    // poll() 的超时依赖 IORING_ENTER_EXT_ARG（5.11）
+    if (!(params.features & IORING_FEAT_EXT_ARG))
+    {
+        LOG_WARN << "io_uring lacks IORING_FEAT_EXT_ARG";
+        return false;
+    }
+
+    sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMmap)
+    {
+        sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+    }
+
+    sqRing_ = ::mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, ringfd_, IORING_OFF_SQ_RING);
+    if (sqRing_ == MAP_FAILED)
+    {
+        LOG_WARN << "io_uring mmap sq ring failed:" << errno;
+        return false;
+    }
+    if (singleMmap)
+    {
+        cqRing_ = sqRing_;
+    }
+    else
+    {
+        cqRing_ = ::mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, ringfd_, IORING_OFF_CQ_RING);
+        if (cqRing_ == MAP_FAILED)
+        {
+            LOG_WARN << "io_uring mmap cq ring failed:" << errno;
+            return false;
+        }
+    }
+    sqesSize_ = params.sq_entries * sizeof(struct io_uring_sqe);
+    sqes_ = static_cast<struct io_uring_sqe*>(::mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE,
+                                                     MAP_SHARED | MAP_POPULATE, ringfd_, IORING_OFF_SQES));
+    if (sqes_ == MAP_FAILED)
+    {
+        LOG_WARN << "io_uring mmap sqes failed:" << errno;
+        return false;
+    }
+
+    char *sq = static_cast<char*>(sqRing_);
+    sqHead_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sqTail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sqMask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sqArray_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    sqFlags_ = reinterpret_cast<unsigned*>(sq + params.sq_off.flags);
+    sqLocalTail_ = *sqTail_;
+
+    char *cq = static_cast<char*>(cqRing_);
+    cqHead_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cqTail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cqMask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+    cqOverflow_ = reinterpret_cast<unsigned*>(cq + params.cq_off.overflow);
+    lastOverflow_ = *cqOverflow_;
+    return true;
+}
+
+void IoUringPoller::teardownRing()
+{
+    if (sqes_ != MAP_FAILED)
+    {
+        ::munmap(sqes_, sqesSize_);
+        sqes_ = static_cast<struct io_uring_sqe*>(MAP_FAILED);
+    }
+    if (cqRing_ != MAP_FAILED && cqRing_ != sqRing_)
+    {
+        ::munmap(cqRing_, cqRingSize_);
+    }
+    cqRing_ = MAP_FAILED;
+    if (sqRing_ != MAP_FAILED)
+    {
+        ::munmap(sqRing_, sqRingSize_);
+        sqRing_ = MAP_FAILED;
+    }
+    // 关闭 ring 会取消所有还挂着的 poll 请求
+    if (ringfd_ >= 0)
+    {
+        ::close(ringfd_);
+        ringfd_ = -1;
+    }
+}
+
+int IoUringPoller::enter(unsigned toSubmit, unsigned minComplete, unsigned flags, int64_t timeoutUs)
+{
+    // 让内核看到本地填好的 SQE
+    __atomic_store_n(sqTail_, sqLocalTail_, __ATOMIC_RELEASE);
+
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+    ::memset(&arg, 0, sizeof(arg));
+    arg.sigmask_sz = _NSIG / 8;
+    if (timeoutUs >= 0)
+    {
+        ts.tv_sec = timeoutUs / Timestamp::kMicroSecondsPerSecond;
+        ts.tv_nsec = static_cast<long long>(timeoutUs % Timestamp::kMicroSecondsPerSecond) * 1000;
+        arg.ts = reinterpret_cast<uint64_t>(&ts);
+    }
+    return static_cast<int>(::syscall(__NR_io_uring_enter, ringfd_, toSubmit, minComplete,
+                                      flags | IORING_ENTER_EXT_ARG, &arg, sizeof(arg)));
+}
+
+struct io_uring_sqe *IoUringPoller::getSqe()
+{
+    unsigned entries = sqMask_ + 1;
+    unsigned head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+    if (sqLocalTail_ - head >= entries)
+    {
+        // 一轮里修改的 channel 超过了队列长度，先提交一批
+        if (enter(sqLocalTail_ - head, 0, 0, -1) < 0)
+        {
+            LOG_ERROR << "io_uring_enter() submit failed:" << errno;
+        }
+        head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+        if (sqLocalTail_ - head >= entries)
+        {
+            return nullptr;
+        }
+    }
+    unsigned index = sqLocalTail_ & sqMask_;
+    struct io_uring_sqe *sqe = &sqes_[index];
+    ::memset(sqe, 0, sizeof(*sqe));
+    sqArray_[index] = index;
+    ++sqLocalTail_;
+    return sqe;
+}
+
+void IoUringPoller::arm(Channel *channel, PollState *state)
+{
+    struct io_uring_sqe *sqe = getSqe();
+    if (sqe == nullptr)
+    {
+        LOG_ERROR << "IoUringPoller submission queue full, fd=" << channel->fd();
+        return;
+    }
+    if (++nextGeneration_ == 0)
+    {
+        nextGeneration_ = 1;
+    }
+    state->tag = (static_cast<uint64_t>(nextGeneration_) << 32) | static_cast<uint32_t>(channel->fd());
+    state->events = channel->events();
+    state->multishot = channel->edgeTriggered();
+
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = channel->fd();
+    // EPOLLIN/EPOLLOUT/EPOLLPRI 与 POLLIN/POLLOUT/POLLPRI 的取值相同
+    sqe->poll32_events = static_cast<uint32_t>(state->events);
+    sqe->len = state->multishot ? IORING_POLL_ADD_MULTI : 0;
+    sqe->user_data = state->tag;
+}
+
+void IoUringPoller::cancel(PollState *state)
+{
+    if (state->tag == 0)
+    {
+        return;
+    }
+    struct io_uring_sqe *sqe = getSqe();
+    if (sqe == nullptr)
+    {
+        LOG_ERROR << "IoUringPoller submission queue full, poll not cancelled";
+        return;
+    }
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->addr = state->tag;
+    sqe->user_data = kInternalTag;
+    // 之后到达的旧请求的完成事件 tag 对不上，会被直接丢弃
+    state->tag = 0;
+}
+
+void IoUringPoller::sync(Channel *channel, PollState *state)
+{
+    if (channel->isNoneEvent())
+    {
+        cancel(state);
+        return;
+    }
+    if (state->tag != 0
+        && state->events == channel->events()
+        && state->multishot == channel->edgeTriggered())
+    {
+        // 环上的请求已经是想要的样子
+        return;
+    }
+    cancel(state);
+    arm(channel, state);
+}
+
+Timestamp IoUringPoller::poll(int timeoutMs, ChannelList *activeChannels)
+{
+    return pollMicroSeconds(timeoutMs < 0 ? -1 : static_cast<int64_t>(timeoutMs) * 1000, activeChannels);
+}
+
+Timestamp IoUringPoller::pollMicroSeconds(int64_t timeoutUs, ChannelList *activeChannels)
+{
+    // 上一轮触发过的单次 poll 重新提交，fd 仍然就绪时会立即完成（水平触发）
+    for (int fd : rearm_)
+    {
+        Channel *channel = channels_.find(fd);
+        auto st = polls_.find(fd);
+        if (channel != nullptr && st != polls_.end() && st->second.tag == 0
+            && channel->index() == kAdded && !channel->isNoneEvent())
+        {
+            arm(channel, &st->second);
+        }
+    }
+    rearm_.clear();
+
+    // 一次系统调用：提交本轮的所有修改并等待完成事件
+    unsigned toSubmit = sqLocalTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+    int ret = enter(toSubmit, 1, IORING_ENTER_GETEVENTS, timeoutUs);
+    int saveErrno = errno;
+    Timestamp now(LoopClock::refresh());  // 每次 poll 返回刷新一次本线程的缓存时钟
+
+    fillActiveChannels(activeChannels);
+    if (activeChannels->empty())
+    {
+        if (ret < 0 && saveErrno != ETIME && saveErrno != EINTR)
+        {
+            errno = saveErrno;
+            LOG_ERROR << "IoUringPoller::poll() failed";
+        }
+        else
+        {
+            LOG_DEBUG << "timeout!";
+        }
+    }
+    return now;
+}
+
+void IoUringPoller::fillActiveChannels(ChannelList *activeChannels)
+{
+    unsigned head = *cqHead_;
+    unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head)
+    {
+        const struct io_uring_cqe *cqe = &cqes_[head & cqMask_];
+        if (cqe->user_data == kInternalTag)
+        {
+            continue;
+        }
+        int fd = static_cast<int>(cqe->user_data & 0xffffffff);
+        auto st = polls_.find(fd);
+        // 已经被取消或替换的旧请求
+        if (st == polls_.end() || st->second.tag != cqe->user_data)
+        {
+            continue;
+        }
+        PollState &state = st->second;
+        if (!(cqe->flags & IORING_CQE_F_MORE))
+        {
+            // 请求已经结束（单次 poll 触发，或 multishot 被内核终止），下一轮重新提交
+            state.tag = 0;
+            rearm_.push_back(fd);
+        }
+        if (cqe->res == -ECANCELED)
+        {
+            continue;
+        }
+        int revents = cqe->res < 0 ? static_cast<int>(EPOLLERR) : static_cast<int>(cqe->res);
+        // multishot 一轮里可能完成多次，同一个 channel 只加入一次
+        if (state.revents == 0)
+        {
+            activeChannels->push_back(ActiveChannel{channels_.find(fd), fd, channels_.generation(fd)});
+        }
+        state.revents |= revents;
+    }
+    __atomic_store_n(cqHead_, tail, __ATOMIC_RELEASE);
+
+    /**
+     * 完成队列满时，支持 IORING_FEAT_NODROP 的内核把多出的完成事件暂存起来并设置 IORING_SQ_CQ_OVERFLOW，
+     * 下一次带 IORING_ENTER_GETEVENTS 的 io_uring_enter（即下一轮 poll）会取回，只是晚一轮；
+     * 老内核直接丢弃并累加 overflow，丢掉的单次 poll 不会再触发，对应的连接会卡住
+     */
+    bool overflowed = (__atomic_load_n(sqFlags_, __ATOMIC_ACQUIRE) & IORING_SQ_CQ_OVERFLOW) != 0;
+    if (overflowed && !cqOverflowed_)
+    {
+        LOG_WARN << "IoUringPoller completion queue overflowed, " << polls_.size() << " fds registered";
+    }
+    cqOverflowed_ = overflowed;
+    unsigned dropped = __atomic_load_n(cqOverflow_, __ATOMIC_ACQUIRE);
+    if (dropped != lastOverflow_)
+    {
+        LOG_ERROR << "IoUringPoller dropped " << dropped - lastOverflow_ << " completions";
+        lastOverflow_ = dropped;
+    }
+
+    for (const ActiveChannel &active : *activeChannels)
+    {
+        PollState &state = polls_[active.fd];
+        active.channel->set_revents(state.revents);
+        state.revents = 0;
+    }
+}
+
+void IoUringPoller::updateChannel(Channel *channel)
+{
+    const int index = channel->index();
+    int fd = channel->fd();
+
+    if (index == kNew || index == kDeleted)
+    {
+        if (index == kNew)
+        {
+            channels_.insert(fd, channel);
+            polls_[fd] = PollState{0, 0, false, 0};
+        }
+        channel->set_index(kAdded);
+        sync(channel, &polls_[fd]);
+    }
+    else
+    {
+        // 没有感兴趣事件时保留在 map 中，只取消环上的请求，与 EPollPoller 的 kDeleted 一致
+        if (channel->isNoneEvent())
+        {
+            channel->set_index(kDeleted);
+        }
+        sync(channel, &polls_[fd]);
+    }
+}
+
+void IoUringPoller::removeChannel(Channel *channel)
+{
+    int fd = channel->fd();
+    channels_.erase(fd);
+
+    auto st = polls_.find(fd);
+    if (st != polls_.end())
+    {
+        cancel(&st->second);
+        polls_.erase(st);
+    }
+    // 重新设置channel的状态为未被Poller注册
+    channel->set_index(kNew);
+}
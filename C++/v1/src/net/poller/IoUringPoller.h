@@ -0,0 +1,97 @@
+#ifndef IOURINGPOLLER_H
+#define IOURINGPOLLER_H
+
+#include <stdint.h>
+#include <vector>
+#include <unordered_map>
+#include <linux/io_uring.h>
+
+#include "Logging.h"
+#include "Poller.h"
+#include "Timestamp.h"
+
+/**
+ * 基于 io_uring 的 Poller，对 Channel 提供与 EPollPoller 相同的接口
+ *
+ * 1. 关注事件通过 IORING_OP_POLL_ADD 提交，poll() 里一次 io_uring_enter
+ *    同时完成“提交本轮的注册/修改”和“等待就绪事件”，不再逐个调用 epoll_ctl
+ * 2. 水平触发的 Channel 使用单次 poll，触发后在下一次 poll() 时重新提交，
+ *    fd 仍然就绪就会立即再次完成，语义与 epoll 的水平触发一致
+ * 3. 边缘触发的 Channel（Channel::edgeTriggered）使用 multishot poll，常驻内核
+ *
+ * 不依赖 liburing，直接使用内核头文件中的结构和系统调用
+ * 内核不支持时 valid() 返回 false，由 Poller::newDefaultPoller 退回 epoll
+ */
+class IoUringPoller : public Poller
+{
+public:
+    IoUringPoller(EventLoop *loop);
+    ~IoUringPoller() override;
+
+    // 初始化是否成功（内核版本过低、被禁用等情况会失败）
+    bool valid() const { return ringfd_ >= 0; }
+
+    // 重写基类Poller的抽象方法
+    Timestamp poll(int timeoutMs, ChannelList *activeChannels) override;
+    // io_uring_enter 的超时本身就是 timespec，直接精确到微秒
+    Timestamp pollMicroSeconds(int64_t timeoutUs, ChannelList *activeChannels) override;
+    void updateChannel(Channel *channel) override;
+    void removeChannel(Channel *channel) override;
+
+private:
+    static const unsigned kRingEntries = 1024;
+
+    // 每个已注册 fd 在环上的状态
+    struct PollState
+    {
+        uint64_t tag;       // 当前 poll 请求的 user_data，为 0 表示没有挂着的请求
+        int events;         // 当前请求关注的事件
+        bool multishot;     // 当前请求是否是 multishot
+        int revents;        // 本轮收集到的就绪事件
+    };
+
+    bool setupRing();
+    void teardownRing();
+
+    // 取一个空闲的 SQE，队列满时先把已有的提交给内核
+    struct io_uring_sqe *getSqe();
+    // 为 channel 提交 poll 请求 / 取消当前请求
+    void arm(Channel *channel, PollState *state);
+    void cancel(PollState *state);
+    // 根据 channel 当前关注的事件调整环上的请求
+    void sync(Channel *channel, PollState *state);
+    // 把内核返回的完成事件转换成活跃的 channel
+    void fillActiveChannels(ChannelList *activeChannels);
+    int enter(unsigned toSubmit, unsigned minComplete, unsigned flags, int64_t timeoutUs);
+
+    int ringfd_;
+
+    // 提交队列
+    void *sqRing_;
+    size_t sqRingSize_;
+    unsigned *sqHead_;
+    unsigned *sqTail_;
+    unsigned sqMask_;
+    unsigned *sqArray_;
+    struct io_uring_sqe *sqes_;
+    size_t sqesSize_;
+    unsigned *sqFlags_;     // 内核设置的状态位，IORING_SQ_CQ_OVERFLOW 表示完成队列溢出
+    unsigned sqLocalTail_;  // 已填写但还没提交的 SQE 的尾部
+
+    // 完成队列
+    void *cqRing_;
+    size_t cqRingSize_;
+    unsigned *cqHead_;
+    unsigned *cqTail_;
+    unsigned cqMask_;
+    struct io_uring_cqe *cqes_;
+    unsigned *cqOverflow_;  // 内核丢弃的完成事件数（不支持 IORING_FEAT_NODROP 的内核）
+    unsigned lastOverflow_;
+    bool cqOverflowed_;     // 上一次检查时完成队列是否处于溢出状态，只在状态变化时打日志
+
+    uint32_t nextGeneration_;                   // 每次提交 poll 请求递增，用来识别过期的完成事件
+    std::unordered_map<int, PollState> polls_;  // fd -> 环上的状态
+    std::vector<int> rearm_;                    // 单次 poll 已经触发、下一轮需要重新提交的 fd
+};
+
+#endif // IOURINGPOLLER_H
@@ -5,27 +5,55 @@
 #include "Channel.h"
 #include "Timestamp.h"
 
+#include <stdint.h>
 #include <vector>
-#include <unordered_map>
+#include <algorithm>
 
 
+enum class PollerBackend;   // 定义在 EventLoop.h
+
 // muduo库中多路事件分发器的核心IO复用模块
 class Poller : noncopyable
 {
 public:
-    using ChannelList = std::vector<Channel*>;
+    // 活跃的 channel，连同取到事件时它的 fd 和注册代数，分发前用 stillActive 再次校验
+    struct ActiveChannel
+    {
+        Channel *channel;
+        int fd;
+        uint32_t generation;
+    };
+    using ChannelList = std::vector<ActiveChannel>;
 
     Poller(EventLoop *Loop);
     virtual ~Poller() = default;
 
     // 需要交给派生类实现的接口
     virtual Timestamp poll(int timeoutMs, ChannelList *activeChannels) = 0;
+    /**
+     * 微秒精度的超时，定时器并入 poll 超时时使用（见 TimerQueue::setPollMode）
+     * 默认向上取整到毫秒调用 poll，保证不会早于定时器到期返回
+     */
+    virtual Timestamp pollMicroSeconds(int64_t timeoutUs, ChannelList *activeChannels)
+    {
+        return poll(timeoutUs < 0 ? -1 : static_cast<int>((timeoutUs + 999) / 1000), activeChannels);
+    }
     virtual void updateChannel(Channel *channel) = 0;
     virtual void removeChannel(Channel *channel) = 0;
 
     // 判断 channel是否注册到 poller当中
     bool hasChannel(Channel *channel) const;
 
+    /**
+     * 同一批事件中，前面的回调可能已经移除甚至释放了后面的 channel（例如关闭连接、销毁 Connector），
+     * 分发前确认表中这个 fd 仍是同一个 channel 的同一次注册；只比较指针值和代数，不解引用 channel
+     */
+    bool stillActive(const ActiveChannel &active) const
+    {
+        return channels_.find(active.fd) == active.channel
+            && channels_.generation(active.fd) == active.generation;
+    }
+
     // EventLoop可以通过该接口获取默认的IO复用实现方式(默认epoll)
     /** 
      * 它的实现并不在 Poller.cc 文件中
@@ -33,10 +61,52 @@ public:
      * 那么外面就会在基类引用派生类的头文件，这个抽象的设计就不好
      * 所以外面会单独创建一个 DefaultPoller.cc 的文件去实现
      */
-    static Poller* newDefaultPoller(EventLoop *Loop);
+    static Poller* newDefaultPoller(EventLoop *Loop, PollerBackend backend);
 
 protected:  
-    using ChannelMap = std::unordered_map<int, Channel*>;
+    /**
+     * 以 fd 为下标的平坦表，fd 是小而稠密的整数，增删查都不需要哈希
+     * 每个槽位带一个代数，同一个 fd 每次重新注册都会加一，
+     * Poller 把代数一起交给内核，就能识别 fd 被关闭又复用后才到达的旧事件
+     */
+    class ChannelMap
+    {
+    public:
+        Channel *find(int fd) const
+        {
+            return static_cast<size_t>(fd) < slots_.size() ? slots_[fd].channel : nullptr;
+        }
+        uint32_t generation(int fd) const
+        {
+            return static_cast<size_t>(fd) < slots_.size() ? slots_[fd].generation : 0;
+        }
+        // 注册 channel，返回这次注册的代数
+        uint32_t insert(int fd, Channel *channel)
+        {
+            if (static_cast<size_t>(fd) >= slots_.size())
+            {
+                slots_.resize(std::max(static_cast<size_t>(fd) + 1, slots_.size() * 2));
+            }
+            slots_[fd].channel = channel;
+            return ++slots_[fd].generation;
+        }
+        void erase(int fd)
+        {
+            if (static_cast<size_t>(fd) < slots_.size())
+            {
+                slots_[fd].channel = nullptr;
+            }
+        }
+
+    private:
+        struct Slot
+        {
+            Channel *channel = nullptr;
+            uint32_t generation = 0;
+        };
+        std::vector<Slot> slots_;
+    };
+
     // 储存 channel 的映射，（sockfd -> channel*）
     ChannelMap channels_;
     
@@ -0,0 +1,151 @@
+#include "EventLoop.h"
+#include "EventLoopThread.h"
+#include "TcpServer.h"
+#include "Logging.h"
+#include "Timestamp.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * 短连接吞吐测试：客户端不断 建立连接 -> 发 64 字节 -> 读回显 -> 关闭，统计每秒完成的连接数
+ * 客户端先关闭，回环地址上 TIME_WAIT 的端口可以复用（net.ipv4.tcp_tw_reuse 默认对回环开启）
+ *   default:  mainLoop accept 后转交 subLoop，连接按名字登记在 mainLoop
+ *   registry: 连接登记在 IO 线程的登记表中（setShardedRegistry）
+ *   fastpath: setShortLivedFastPath
+ *   perloop:  每个 IO 线程各自 accept（setAcceptPerLoop）+ fastpath
+ * 用法: ./ConnChurnBench [客户端线程数] [每轮秒数] [IO 线程数]
+ */
+
+enum Mode
+{
+    kDefault,
+    kRegistry,
+    kFastPath,
+    kPerLoop,
+};
+
+const char *modeName(Mode mode)
+{
+    switch (mode)
+    {
+    case kRegistry: return "registry";
+    case kFastPath: return "fastpath";
+    case kPerLoop: return "perloop";
+    default: return "default";
+    }
+}
+
+void runClient(uint16_t port, const std::atomic<bool> &stop, std::atomic<long> *connections)
+{
+    sockaddr_in addr;
+    ::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    char request[64];
+    ::memset(request, 'x', sizeof(request));
+    char buf[64];
+    long count = 0;
+    while (!stop.load(std::memory_order_relaxed))
+    {
+        int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0)
+        {
+            ::close(fd);
+            continue;
+        }
+        size_t got = 0;
+        if (::write(fd, request, sizeof(request)) == sizeof(request))
+        {
+            while (got < sizeof(buf))
+            {
+                ssize_t n = ::read(fd, buf, sizeof(buf) - got);
+                if (n <= 0)
+                {
+                    break;
+                }
+                got += n;
+            }
+        }
+        ::close(fd);
+        if (got == sizeof(buf))
+        {
+            ++count;
+        }
+    }
+    connections->fetch_add(count);
+}
+
+void benchmark(Mode mode, int clients, double seconds, int ioThreads, uint16_t port)
+{
+    EventLoopThread loopThread;
+    EventLoop *loop = loopThread.startLoop();
+
+    TcpServer server(loop, InetAddress(port), "ConnChurnBench", TcpServer::kReusePort);
+    server.setThreadNum(ioThreads);
+    if (mode == kRegistry)
+    {
+        server.setShardedRegistry(true);
+    }
+    if (mode == kFastPath || mode == kPerLoop)
+    {
+        server.setShortLivedFastPath(true);
+    }
+    if (mode == kPerLoop)
+    {
+        server.setAcceptPerLoop(true);
+    }
+    server.setConnectionCallback([](const TcpConnectionPtr &) {});
+    server.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+        conn->send(buf);
+    });
+    server.start();
+    ::usleep(100 * 1000);
+
+    std::atomic<bool> stop(false);
+    std::atomic<long> connections(0);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < clients; ++i)
+    {
+        threads.emplace_back(runClient, port, std::cref(stop), &connections);
+    }
+    Timestamp start(Timestamp::now());
+    ::usleep(static_cast<useconds_t>(seconds * 1000 * 1000));
+    stop = true;
+    for (std::thread &t : threads)
+    {
+        t.join();
+    }
+    double elapsed = timeDifference(Timestamp::now(), start);
+    // 等服务端处理完最后的关闭
+    ::usleep(100 * 1000);
+
+    printf("%-8s clients=%3d ioThreads=%d connections/sec=%.0f\n",
+           modeName(mode), clients, ioThreads, connections.load() / elapsed);
+}
+
+int main(int argc, char *argv[])
+{
+    Logger::setLogLevel(Logger::WARN);
+    int clients = argc > 1 ? atoi(argv[1]) : 8;
+    double seconds = argc > 2 ? atof(argv[2]) : 3.0;
+    int ioThreads = argc > 3 ? atoi(argv[3]) : 2;
+    uint16_t port = 9991;
+
+    benchmark(kDefault, clients, seconds, ioThreads, port++);
+    benchmark(kRegistry, clients, seconds, ioThreads, port++);
+    benchmark(kFastPath, clients, seconds, ioThreads, port++);
+    benchmark(kPerLoop, clients, seconds, ioThreads, port++);
+    return 0;
+}
@@ -0,0 +1,147 @@
+#include "EventLoop.h"
+#include "EventLoopThread.h"
+#include "TcpServer.h"
+#include "Logging.h"
+#include "Timestamp.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+/**
+ * EPollPoller 与 IoUringPoller 的对比测试
+ * 服务端单个 loop 线程，客户端多个阻塞连接做一问一答，统计每秒完成的请求数
+ *   echo: 回显 64 字节消息
+ *   http: 固定的 keep-alive GET 请求和 200 响应，模拟小 HTTP 请求
+ * 用法: ./PollerBench [连接数] [每轮秒数]
+ */
+
+const char kHttpRequest[] = "GET /hello HTTP/1.1\r\nHost: localhost\r\nConnection: Keep-Alive\r\n\r\n";
+const char kHttpResponse[] = "HTTP/1.1 200 OK\r\nContent-Length: 12\r\nConnection: Keep-Alive\r\n"
+                             "Content-Type: text/plain\r\n\r\nhello world\n";
+
+int connectTo(uint16_t port)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    ::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0)
+    {
+        perror("connect");
+        exit(1);
+    }
+    int one = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+// 客户端：发请求，读满响应长度后再发下一个
+void runClient(uint16_t port, const std::string &request, size_t responseLen,
+               const std::atomic<bool> &stop, std::atomic<long> *requests)
+{
+    int fd = connectTo(port);
+    char buf[4096];
+    long count = 0;
+    while (!stop.load(std::memory_order_relaxed))
+    {
+        if (::write(fd, request.data(), request.size()) != static_cast<ssize_t>(request.size()))
+        {
+            break;
+        }
+        size_t got = 0;
+        while (got < responseLen)
+        {
+            ssize_t n = ::read(fd, buf, sizeof(buf));
+            if (n <= 0)
+            {
+                ::close(fd);
+                return;
+            }
+            got += n;
+        }
+        ++count;
+    }
+    requests->fetch_add(count);
+    ::close(fd);
+}
+
+void benchmark(PollerBackend backend, bool http, int connections, double seconds, uint16_t port)
+{
+    EventLoopThread loopThread;
+    loopThread.setPollerBackend(backend);
+    EventLoop *loop = loopThread.startLoop();
+
+    TcpServer server(loop, InetAddress(port), "PollerBench");
+    server.setConnectionCallback([](const TcpConnectionPtr &) {});
+    if (http)
+    {
+        server.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+            const size_t len = sizeof(kHttpRequest) - 1;
+            std::string_view response(kHttpResponse, sizeof(kHttpResponse) - 1);
+            while (buf->readableBytes() >= len)
+            {
+                buf->retrieve(len);
+                conn->send(&response, 1);
+            }
+        });
+    }
+    else
+    {
+        server.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+            conn->send(buf);
+        });
+    }
+    server.start();
+    ::usleep(100 * 1000);
+
+    std::string request = http ? std::string(kHttpRequest) : std::string(64, 'x');
+    size_t responseLen = http ? sizeof(kHttpResponse) - 1 : request.size();
+    std::atomic<bool> stop(false);
+    std::atomic<long> requests(0);
+    std::vector<std::thread> clients;
+    for (int i = 0; i < connections; ++i)
+    {
+        clients.emplace_back(runClient, port, std::cref(request), responseLen,
+                             std::cref(stop), &requests);
+    }
+    Timestamp start(Timestamp::now());
+    ::usleep(static_cast<useconds_t>(seconds * 1000 * 1000));
+    stop = true;
+    for (std::thread &t : clients)
+    {
+        t.join();
+    }
+    double elapsed = timeDifference(Timestamp::now(), start);
+
+    printf("%-8s %-4s connections=%3d requests/sec=%.0f\n",
+           backend == PollerBackend::kIoUring ? "io_uring" : "epoll",
+           http ? "http" : "echo", connections, requests.load() / elapsed);
+}
+
+int main(int argc, char *argv[])
+{
+    Logger::setLogLevel(Logger::WARN);
+    int connections = argc > 1 ? atoi(argv[1]) : 32;
+    double seconds = argc > 2 ? atof(argv[2]) : 3.0;
+    uint16_t port = 9981;
+
+    for (int http = 0; http < 2; ++http)
+    {
+        benchmark(PollerBackend::kEpoll, http, connections, seconds, port++);
+        benchmark(PollerBackend::kIoUring, http, connections, seconds, port++);
+    }
+    return 0;
+}
@@ -0,0 +1,74 @@
+#include "EventLoop.h"
+#include "EventLoopThread.h"
+#include "Logging.h"
+#include "Timestamp.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+/**
+ * queueInLoop 跨线程投递吞吐测试
+ * 多个生产者线程同时向同一个 EventLoop 投递绑定了 shared_ptr 的任务，统计每秒投递数
+ * 用法: ./QueueInLoopBench [每个生产者投递次数]
+ */
+
+std::atomic<long> g_done(0);
+
+// 模拟常见的 std::bind(&TcpConnection::xxx, shared_from_this()) 投递
+struct Counter
+{
+    void increase() { g_done.fetch_add(1, std::memory_order_relaxed); }
+};
+
+void benchmark(EventLoop *loop, int producers, long postsPerProducer)
+{
+    g_done = 0;
+    long total = producers * postsPerProducer;
+    Timestamp start(Timestamp::now());
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < producers; ++i)
+    {
+        threads.emplace_back([loop, postsPerProducer] {
+            std::shared_ptr<Counter> counter(new Counter);
+            for (long j = 0; j < postsPerProducer; ++j)
+            {
+                loop->queueInLoop(std::bind(&Counter::increase, counter));
+            }
+        });
+    }
+    for (std::thread &t : threads)
+    {
+        t.join();
+    }
+    // 等 loop 线程把任务全部执行完
+    while (g_done.load(std::memory_order_relaxed) < total)
+    {
+        std::this_thread::yield();
+    }
+
+    double seconds = timeDifference(Timestamp::now(), start);
+    printf("producers=%2d posts=%ld time=%.3fs posts/sec=%.0f\n",
+           producers, total, seconds, total / seconds);
+}
+
+int main(int argc, char *argv[])
+{
+    Logger::setLogLevel(Logger::WARN);
+    long postsPerProducer = argc > 1 ? atol(argv[1]) : 1000000;
+
+    EventLoopThread loopThread;
+    EventLoop *loop = loopThread.startLoop();
+
+    int counts[] = {1, 2, 4, 8, 16};
+    for (int producers : counts)
+    {
+        benchmark(loop, producers, postsPerProducer);
+    }
+    return 0;
+}
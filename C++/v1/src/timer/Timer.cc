@@ -1,5 +1,7 @@
 #include "Timer.h"
 
+std::atomic<int64_t> Timer::s_numCreated_(0);
+
 void Timer::restart(Timestamp now)
 {
     if (repeat_)
@@ -7,8 +9,8 @@ void Timer::restart(Timestamp now)
         // 如果是重复定时事件，则继续添加定时事件，得到新事件到期事件
         expiration_ = addTime(now, interval_);
     }
-    else 
+    else
     {
         expiration_ = Timestamp();
     }
-}
\ No newline at end of file
+}
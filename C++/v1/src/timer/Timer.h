@@ -3,41 +3,85 @@
 
 #include "noncopyable.h"
 #include "Timestamp.h"
-#include <functional>
+#include "Task.h"
+
+#include <stdint.h>
+#include <atomic>
 
 /**
  * Timer用于描述一个定时器
  * 定时器回调函数，下一次超时时刻，重复定时器的时间间隔等
+ *
+ * 同时也是时间轮上的链表节点，由 TimerQueue 池化复用：
+ * 到期或取消后放回空闲链表，下一次 addTimer 重新 init，不再反复 new/delete
  */
 class Timer : noncopyable
 {
 public:
-    using TimerCallback = std::function<void()>;
+    using TimerCallback = Task;
 
-    Timer(TimerCallback cb, Timestamp when, double interval)
-        : callback_(move(cb)),
-          expiration_(when),
-          interval_(interval),
-          repeat_(interval > 0.0) // 一次性定时器设置为0
+    Timer()
+        : expiration_(),
+          interval_(0.0),
+          repeat_(false),
+          sequence_(0),
+          tick_(0),
+          prev_(nullptr),
+          next_(nullptr),
+          level_(0),
+          slot_(0),
+          state_(kFree)
     {
     }
 
-    void run() const 
-    { 
-        callback_(); 
+    // 从池中取出后重新设置，每次都分配新的序号，旧的 TimerId 因此失效
+    void init(TimerCallback cb, Timestamp when, double interval)
+    {
+        callback_ = std::move(cb);
+        expiration_ = when;
+        interval_ = interval;
+        repeat_ = interval > 0.0; // 一次性定时器设置为0
+        sequence_ = s_numCreated_.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+
+    void run() const
+    {
+        callback_();
     }
 
     Timestamp expiration() const  { return expiration_; }
     bool repeat() const { return repeat_; }
+    int64_t sequence() const { return sequence_; }
 
     // 重启定时器(如果是非重复事件则到期时间置为0)
     void restart(Timestamp now);
 
 private:
-    const TimerCallback callback_;  // 定时器回调函数
-    Timestamp expiration_;          // 下一次的超时时刻
-    const double interval_;         // 超时时间间隔，如果是一次性定时器，该值为0
-    const bool repeat_;             // 是否重复(false 表示是一次性定时器)
+    friend class TimerQueue;
+
+    enum State
+    {
+        kFree,      // 在空闲链表中
+        kPending,   // 挂在时间轮上
+        kExpired,   // 已经到期，正在本轮执行
+        kCanceled,  // 本轮执行期间被取消，执行完不再重复
+    };
+
+    static std::atomic<int64_t> s_numCreated_;
+
+    TimerCallback callback_;    // 定时器回调函数
+    Timestamp expiration_;      // 下一次的超时时刻（单调时钟，见 LoopClock）
+    double interval_;           // 超时时间间隔，如果是一次性定时器，该值为0
+    bool repeat_;               // 是否重复(false 表示是一次性定时器)
+    int64_t sequence_;          // 全局递增序号，和 TimerId 中的比对
+
+    // 以下由 TimerQueue 维护
+    uint64_t tick_;             // 到期的时间轮刻度（毫秒）
+    Timer *prev_;               // 槽内双向链表，取消时 O(1) 摘除
+    Timer *next_;
+    uint8_t level_;             // 所在的层和槽
+    uint8_t slot_;
+    State state_;
 };
 
-#endif // TIMER_H
\ No newline at end of file
+#endif // TIMER_H
@@ -0,0 +1,36 @@
+#ifndef TIMER_ID_H
+#define TIMER_ID_H
+
+#include <stdint.h>
+
+class Timer;
+
+/**
+ * runAt / runAfter / runEvery 返回的定时器标识，用于 EventLoop::cancel
+ * 可以随意复制；Timer 节点会被复用，所以同时记录序号，序号不一致说明定时器已经结束
+ */
+class TimerId
+{
+public:
+    TimerId()
+        : timer_(nullptr),
+          sequence_(0)
+    {
+    }
+
+    TimerId(Timer *timer, int64_t seq)
+        : timer_(timer),
+          sequence_(seq)
+    {
+    }
+
+    bool valid() const { return timer_ != nullptr; }
+
+    friend class TimerQueue;
+
+private:
+    Timer *timer_;
+    int64_t sequence_;
+};
+
+#endif // TIMER_ID_H
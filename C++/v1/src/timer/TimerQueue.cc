@@ -7,6 +7,8 @@
 #include <sys/timerfd.h>
 #include <unistd.h>
 #include <string.h>
+#include <stdlib.h>
+#include <algorithm>
 
 int createTimerfd()
 {
@@ -25,48 +27,160 @@ int createTimerfd()
 
 TimerQueue::TimerQueue(EventLoop* loop)
     : loop_(loop),
-      timerfd_(createTimerfd()),
-      timerfdChannel_(loop_, timerfd_),
-      timers_()
+      timerfd_(-1),
+      pollMode_(::getenv("MUDUO_TIMER_IN_POLL") != nullptr),
+      useCachedClock_(false),
+      currentTick_(toTick(Timestamp(LoopClock::preciseMonotonicMicroSeconds()))),
+      armedTick_(kNotArmed),
+      count_(0),
+      freeList_(nullptr),
+      callingExpiredTimers_(false)
 {
-    timerfdChannel_.setReadCallback(
-        std::bind(&TimerQueue::handleRead, this));
-    timerfdChannel_.enableReading();
+    memset(wheel_, 0, sizeof(wheel_));
+    memset(occupied_, 0, sizeof(occupied_));
+    if (!pollMode_)
+    {
+        setPollModeInLoop(false);
+    }
 }
 
 TimerQueue::~TimerQueue()
-{   
-    timerfdChannel_.disableAll();
-    timerfdChannel_.remove();
-    ::close(timerfd_);
-    // 删除所有定时器
-    for (const Entry& timer : timers_)
+{
+    if (timerfdChannel_)
+    {
+        timerfdChannel_->disableAll();
+        timerfdChannel_->remove();
+        ::close(timerfd_);
+    }
+    // 删除所有定时器，包括时间轮上的和池中空闲的
+    for (int level = 0; level < kLevels; ++level)
     {
-        delete timer.second;
+        for (int slot = 0; slot < kSlots; ++slot)
+        {
+            Timer* timer = wheel_[level][slot];
+            while (timer)
+            {
+                Timer* next = timer->next_;
+                delete timer;
+                timer = next;
+            }
+        }
     }
+    while (freeList_)
+    {
+        Timer* next = freeList_->next_;
+        delete freeList_;
+        freeList_ = next;
+    }
+}
+
+TimerId TimerQueue::addTimer(TimerCallback cb,
+                             Timestamp when,
+                             double interval)
+{
+    // 墙上时间换算成单调时间：只在插入时参考一次系统时间
+    int64_t delta = when.microSecondsSinceEpoch() - Timestamp::now().microSecondsSinceEpoch();
+    return addTimerMonotonic(std::move(cb),
+                             Timestamp(LoopClock::preciseMonotonicMicroSeconds() + delta),
+                             interval);
+}
+
+TimerId TimerQueue::addTimerAfter(TimerCallback cb,
+                                  double delay,
+                                  double interval)
+{
+    return addTimerMonotonic(std::move(cb), addTime(monotonicNow(), delay), interval);
 }
 
-void TimerQueue::addTimer(TimerCallback cb,
-                          Timestamp when,
-                          double interval)
+TimerId TimerQueue::addTimerMonotonic(TimerCallback cb,
+                                      Timestamp when,
+                                      double interval)
 {
-    Timer* timer = new Timer(std::move(cb), when, interval);
+    // 节点池只在loop线程访问，其他线程添加时单独分配，结束后同样放回池中
+    Timer* timer = loop_->isInLoopThread() ? allocTimer() : new Timer;
+    timer->init(std::move(cb), when, interval);
+    TimerId id(timer, timer->sequence());
     loop_->runInLoop(
         std::bind(&TimerQueue::addTimerInLoop, this, timer));
+    return id;
+}
+
+void TimerQueue::cancel(TimerId timerId)
+{
+    loop_->runInLoop(
+        std::bind(&TimerQueue::cancelInLoop, this, timerId));
+}
+
+void TimerQueue::setPollMode(bool on)
+{
+    loop_->runInLoop(
+        std::bind(&TimerQueue::setPollModeInLoop, this, on));
+}
+
+void TimerQueue::setPollModeInLoop(bool on)
+{
+    pollMode_ = on;
+    if (on && timerfdChannel_)
+    {
+        timerfdChannel_->disableAll();
+        timerfdChannel_->remove();
+        timerfdChannel_.reset();
+        ::close(timerfd_);
+        timerfd_ = -1;
+        armedTick_ = kNotArmed;
+    }
+    else if (!on && !timerfdChannel_)
+    {
+        timerfd_ = createTimerfd();
+        timerfdChannel_.reset(new Channel(loop_, timerfd_));
+        timerfdChannel_->setReadCallback(
+            std::bind(&TimerQueue::handleRead, this));
+        timerfdChannel_->enableReading();
+        rearm();
+    }
 }
 
 void TimerQueue::addTimerInLoop(Timer* timer)
 {
-    // 是否取代了最早的定时触发时间
-    bool eraliestChanged = insert(timer);
+    if (count_ == 0)
+    {
+        // 时间轮空着时没有唤醒，currentTick_ 停在上一次处理的刻度，先追上当前时间，新定时器按真实距离放层
+        currentTick_ = std::max(currentTick_,
+                                static_cast<uint64_t>(monotonicNow().microSecondsSinceEpoch() / 1000));
+    }
+    // 当前刻度已经处理过，落在当前刻度及以前的定时器放到下一个刻度
+    timer->tick_ = std::max(toTick(timer->expiration()), currentTick_ + 1);
+    timer->state_ = Timer::kPending;
+    link(timer);
 
-    // 我们需要重新设置timerfd_触发时间
-    if (eraliestChanged)
+    // 比 timerfd 设置的更早才需要重设；执行到期回调期间不重设，handleRead 末尾统一设置
+    if (!callingExpiredTimers_ && timer->tick_ < armedTick_)
     {
-        resetTimerfd(timerfd_, timer->expiration());
+        rearm();
     }
 }
 
+void TimerQueue::cancelInLoop(TimerId timerId)
+{
+    Timer* timer = timerId.timer_;
+    // 序号不同说明节点已经被复用，对应的定时器早已结束
+    if (timer == nullptr || timer->sequence_ != timerId.sequence_)
+    {
+        return;
+    }
+    if (timer->state_ == Timer::kPending)
+    {
+        unlink(timer);
+        releaseTimer(timer);
+    }
+    else if (timer->state_ == Timer::kExpired)
+    {
+        // 正在执行本轮到期的定时器，还没执行的不再执行，重复定时器也不再插回
+        timer->state_ = Timer::kCanceled;
+    }
+    // timerfd 不因取消而重设，多唤醒一次也只是空转
+}
+
 // 重置timerfd
 void TimerQueue::resetTimerfd(int timerfd_, Timestamp expiration)
 {
@@ -75,109 +189,279 @@ void TimerQueue::resetTimerfd(int timerfd_, Timestamp expiration)
     memset(&newValue, '\0', sizeof(newValue));
     memset(&oldValue, '\0', sizeof(oldValue));
 
-    // 超时时间 - 现在时间
-    int64_t microSecondDif = expiration.microSecondsSinceEpoch() - Timestamp::now().microSecondsSinceEpoch();
-    if (microSecondDif < 100)
-    {
-        microSecondDif = 100;
-    }
-
+    // 到期时间是 CLOCK_MONOTONIC 上的绝对时间，直接交给内核，不需要再读一次当前时间
+    // 已经过去的时间内核会立即触发
+    int64_t microSeconds = expiration.microSecondsSinceEpoch();
     struct timespec ts;
     ts.tv_sec = static_cast<time_t>(
-        microSecondDif / Timestamp::kMicroSecondsPerSecond);
+        microSeconds / Timestamp::kMicroSecondsPerSecond);
     ts.tv_nsec = static_cast<long>(
-        (microSecondDif % Timestamp::kMicroSecondsPerSecond) * 1000);
+        (microSeconds % Timestamp::kMicroSecondsPerSecond) * 1000);
     newValue.it_value = ts;
     // 此函数会唤醒事件循环
-    if (::timerfd_settime(timerfd_, 0, &newValue, &oldValue))
+    if (::timerfd_settime(timerfd_, TFD_TIMER_ABSTIME, &newValue, &oldValue))
     {
         LOG_ERROR << "timerfd_settime faield()";
     }
 }
 
-void ReadTimerFd(int timerfd) 
+void TimerQueue::rearm()
+{
+    // poll 模式下由 EventLoop 每轮按 nextTimeoutMicroSeconds 设置超时
+    if (pollMode_ || count_ == 0)
+    {
+        return;
+    }
+    uint64_t tick = nextEventTick();
+    if (tick != armedTick_)
+    {
+        armedTick_ = tick;
+        resetTimerfd(timerfd_, Timestamp(static_cast<int64_t>(tick * 1000)));
+    }
+}
+
+int64_t TimerQueue::nextTimeoutMicroSeconds(Timestamp now) const
+{
+    if (count_ == 0)
+    {
+        return -1;
+    }
+    int64_t timeout = static_cast<int64_t>(nextEventTick() * 1000) - now.microSecondsSinceEpoch();
+    return timeout > 0 ? timeout : 0;
+}
+
+uint64_t TimerQueue::nextEventTick() const
+{
+    uint64_t next = kNotArmed;
+    for (int level = 0; level < kLevels; ++level)
+    {
+        uint64_t bits = occupied_[level];
+        if (bits == 0)
+        {
+            continue;
+        }
+        const int shift = level * kLevelBits;
+        const uint64_t cur = (currentTick_ >> shift) & kSlotMask;
+        // 本层这一圈的起始刻度
+        const uint64_t base = (currentTick_ >> (shift + kLevelBits)) << (shift + kLevelBits);
+        // 当前槽之后还没转到的槽属于这一圈，其余的（含当前槽）属于下一圈
+        uint64_t ahead = bits & ~((2ULL << cur) - 1);
+        uint64_t tick;
+        if (ahead)
+        {
+            tick = base + (static_cast<uint64_t>(__builtin_ctzll(ahead)) << shift);
+        }
+        else
+        {
+            tick = base + (1ULL << (shift + kLevelBits))
+                 + (static_cast<uint64_t>(__builtin_ctzll(bits)) << shift);
+        }
+        next = std::min(next, tick);
+    }
+    return next;
+}
+
+void ReadTimerFd(int timerfd)
 {
     uint64_t read_byte;
     ssize_t readn = ::read(timerfd, &read_byte, sizeof(read_byte));
-    
+
     if (readn != sizeof(read_byte)) {
         LOG_ERROR << "TimerQueue::ReadTimerFd read_size < 0";
     }
 }
 
-// 返回删除的定时器节点 （std::vector<Entry> expired）
-std::vector<TimerQueue::Entry> TimerQueue::getExpired(Timestamp now)
+void TimerQueue::advance(uint64_t nowTick)
+{
+    while (currentTick_ < nowTick)
+    {
+        /**
+         * 按位图直接跳到下一个有事的刻度（第 0 层的到期刻度或高层的级联刻度），
+         * 中间的空槽和空的级联都跳过，循环次数只和到期 / 级联的次数有关，和经过的时间无关
+         */
+        uint64_t next = count_ == 0 ? kNotArmed : nextEventTick();
+        if (next > nowTick)
+        {
+            currentTick_ = nowTick;
+            break;
+        }
+        currentTick_ = next;
+        if ((currentTick_ & kSlotMask) == 0)
+        {
+            cascade();
+        }
+
+        // 取出第 0 层当前槽的全部定时器
+        const size_t slot = currentTick_ & kSlotMask;
+        Timer* timer = wheel_[0][slot];
+        wheel_[0][slot] = nullptr;
+        occupied_[0] &= ~(1ULL << slot);
+        while (timer)
+        {
+            Timer* nextTimer = timer->next_;
+            --count_;
+            timer->prev_ = timer->next_ = nullptr;
+            timer->state_ = Timer::kExpired;
+            expired_.push_back(timer);
+            timer = nextTimer;
+        }
+    }
+}
+
+void TimerQueue::cascade()
 {
-    std::vector<Entry> expired;
-    // TODO:???
-    Entry sentry(now, reinterpret_cast<Timer*>(UINTPTR_MAX));
-    TimerList::iterator end = timers_.lower_bound(sentry);
-    std::copy(timers_.begin(), end, back_inserter(expired));
-    timers_.erase(timers_.begin(), end);
-    
-    return expired;
+    for (int level = 1; level < kLevels; ++level)
+    {
+        const size_t slot = (currentTick_ >> (level * kLevelBits)) & kSlotMask;
+        Timer* timer = wheel_[level][slot];
+        wheel_[level][slot] = nullptr;
+        occupied_[level] &= ~(1ULL << slot);
+        while (timer)
+        {
+            Timer* next = timer->next_;
+            --count_;
+            link(timer);
+            timer = next;
+        }
+        // 本层还没转完一圈，更高层不需要下放
+        if (slot != 0)
+        {
+            break;
+        }
+    }
 }
 
 void TimerQueue::handleRead()
 {
-    Timestamp now = Timestamp::now();
+    Timestamp now = monotonicNow();
     ReadTimerFd(timerfd_);
+    armedTick_ = kNotArmed;
+    runExpired(now);
+}
 
-    std::vector<Entry> expired = getExpired(now);
+void TimerQueue::runExpired(Timestamp now)
+{
+    advance(static_cast<uint64_t>(now.microSecondsSinceEpoch() / 1000));
 
-    // 遍历到期的定时器，调用回调函数
+    // 遍历到期的定时器，调用回调函数（回调中被取消的不再执行）
+    bool metrics = loop_->metricsEnabled();
+    loop_->setActivity(EventLoop::kTimers);
     callingExpiredTimers_ = true;
-    for (const Entry& it : expired)
+    for (size_t i = 0; i < expired_.size(); ++i)
     {
-        it.second->run();
+        if (expired_[i]->state_ == Timer::kExpired)
+        {
+            if (metrics)
+            {
+                // 延迟按本批开始处理的时刻计算，不再逐个读时钟；
+                // now 可能来自 loop 缓存的时钟，比到期时间略早时记为 0，避免负值拉低直方图的 sum
+                int64_t lag = now.microSecondsSinceEpoch() - expired_[i]->expiration().microSecondsSinceEpoch();
+                loop_->metrics().timerLagMicroSeconds.record(lag > 0 ? lag : 0);
+            }
+            expired_[i]->run();
+        }
     }
     callingExpiredTimers_ = false;
-    
-    // 重新设置这些定时器
-    reset(expired, now);
-
-}
 
-void TimerQueue::reset(const std::vector<Entry>& expired, Timestamp now)
-{
-    Timestamp nextExpire;
-    for (const Entry& it : expired)
+    // 重复任务插回时间轮，其余的放回节点池
+    for (Timer* timer : expired_)
     {
-        // 重复任务则继续执行
-        if (it.second->repeat())
+        if (timer->state_ == Timer::kExpired && timer->repeat())
         {
-            auto timer = it.second;
-            timer->restart(Timestamp::now());
-            insert(timer);
+            timer->restart(now);
+            timer->tick_ = std::max(toTick(timer->expiration()), currentTick_ + 1);
+            timer->state_ = Timer::kPending;
+            link(timer);
         }
         else
         {
-            delete it.second;
+            releaseTimer(timer);
         }
+    }
+    expired_.clear();
+
+    // 本轮所有变动之后只设置一次 timerfd（poll 模式下什么都不做）
+    rearm();
+}
 
-        // 如果重新插入了定时器，需要继续重置timerfd
-        if (!timers_.empty())
+void TimerQueue::link(Timer* timer)
+{
+    // 调用方保证 tick_ >= currentTick_，相差越远放得越高
+    const uint64_t diff = timer->tick_ - currentTick_;
+    int level = 0;
+    while (level < kLevels - 1 && diff >= (1ULL << (kLevelBits * (level + 1))))
+    {
+        ++level;
+    }
+    uint64_t tick = timer->tick_;
+    if (diff >= (1ULL << (kLevelBits * kLevels)))
+    {
+        // 超出时间轮范围，先放在最高层最远的槽，级联时按真实刻度重新放置
+        tick = currentTick_ + (1ULL << (kLevelBits * kLevels)) - 1;
+    }
+    const size_t slot = (tick >> (level * kLevelBits)) & kSlotMask;
+
+    Timer*& head = wheel_[level][slot];
+    timer->level_ = static_cast<uint8_t>(level);
+    timer->slot_ = static_cast<uint8_t>(slot);
+    timer->prev_ = nullptr;
+    timer->next_ = head;
+    if (head)
+    {
+        head->prev_ = timer;
+    }
+    head = timer;
+    occupied_[level] |= 1ULL << slot;
+    ++count_;
+}
+
+void TimerQueue::unlink(Timer* timer)
+{
+    if (timer->prev_)
+    {
+        timer->prev_->next_ = timer->next_;
+    }
+    else
+    {
+        Timer*& head = wheel_[timer->level_][timer->slot_];
+        head = timer->next_;
+        if (head == nullptr)
         {
-            resetTimerfd(timerfd_, (timers_.begin()->second)->expiration());
+            occupied_[timer->level_] &= ~(1ULL << timer->slot_);
         }
     }
+    if (timer->next_)
+    {
+        timer->next_->prev_ = timer->prev_;
+    }
+    timer->prev_ = timer->next_ = nullptr;
+    --count_;
 }
 
-bool TimerQueue::insert(Timer* timer)
+Timer* TimerQueue::allocTimer()
 {
-    bool earliestChanged = false;
-    Timestamp when = timer->expiration();
-    TimerList::iterator it = timers_.begin();
-    if (it == timers_.end() || when < it->first)
+    if (freeList_ == nullptr)
     {
-        // 说明最早的定时器已经被替换了
-        earliestChanged = true;
+        return new Timer;
     }
-
-    // 定时器管理红黑树插入此新定时器
-    timers_.insert(Entry(when, timer));
-
-    return earliestChanged;
+    Timer* timer = freeList_;
+    freeList_ = timer->next_;
+    timer->next_ = nullptr;
+    return timer;
 }
 
+void TimerQueue::releaseTimer(Timer* timer)
+{
+    // 尽早释放回调持有的资源（例如绑定的 shared_ptr）
+    timer->callback_ = nullptr;
+    timer->state_ = Timer::kFree;
+    timer->prev_ = nullptr;
+    timer->next_ = freeList_;
+    freeList_ = timer;
+}
 
+// 向上取整，保证定时器不会早于到期时间执行
+uint64_t TimerQueue::toTick(Timestamp when)
+{
+    return static_cast<uint64_t>(when.microSecondsSinceEpoch() + 999) / 1000;
+}
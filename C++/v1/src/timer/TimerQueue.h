@@ -3,56 +3,134 @@
 
 #include "Timestamp.h"
 #include "Channel.h"
+#include "Task.h"
+#include "TimerId.h"
+#include "LoopClock.h"
 
+#include <stdint.h>
 #include <vector>
-#include <set>
+#include <memory>
 
 class EventLoop;
 class Timer;
 
+/**
+ * 分层时间轮实现的定时器队列
+ *
+ * 1. 刻度为 1ms，共 kLevels 层，每层 kSlots 个槽，第 l 层一个槽覆盖 64^l 个刻度
+ *    插入、取消都是 O(1)，高层的定时器在对应的槽转到时才下放（级联）到低层
+ * 2. 每层用一个 64 位位图记录非空槽，推进时可以跳过空槽，计算下一次唤醒时间也只看位图
+ * 3. Timer 节点池化复用，TimerId 带序号，节点复用后旧的 TimerId 自动失效
+ * 4. timerfd 只按“下一个有事的刻度”设置，每个刻度最多重设一次
+ * 5. poll 模式（setPollMode 或环境变量 MUDUO_TIMER_IN_POLL）下不使用 timerfd：
+ *    EventLoop 用 nextTimeoutMicroSeconds 作为 poll 超时，poll 返回后调用 runExpired，
+ *    定时器的增删和到期都不需要 epoll_wait 之外的系统调用
+ * 6. 内部统一使用单调时钟（LoopClock），修改系统时间不会让定时器提前或推迟；
+ *    下文 Timestamp 类型的 now / expiration 都是单调时间，只有 addTimer 的 when 是墙上时间
+ */
 class TimerQueue
 {
 public:
-    using TimerCallback = std::function<void()>;
+    using TimerCallback = Task;
 
     explicit TimerQueue(EventLoop* loop);
     ~TimerQueue();
 
     // 插入定时器（回调函数，到期时间，是否重复）
-    void addTimer(TimerCallback cb,
-                  Timestamp when,
-                  double interval);
-    
-private:
-    using Entry = std::pair<Timestamp, Timer*>; // 以时间戳作为键值获取定时器
-    using TimerList = std::set<Entry>;          // 底层使用红黑树管理，自动按照时间戳进行排序
+    // when 是墙上时间，插入时换算成单调时间
+    // 线程安全
+    TimerId addTimer(TimerCallback cb,
+                     Timestamp when,
+                     double interval);
+    // 插入 delay 秒后到期的定时器，直接按单调时钟计算
+    // 线程安全
+    TimerId addTimerAfter(TimerCallback cb,
+                          double delay,
+                          double interval);
 
-    // 在本loop中添加定时器
+    // 取消定时器，已经结束或取消过的 TimerId 直接忽略
     // 线程安全
+    void cancel(TimerId timerId);
+
+    /**
+     * 使用 loop 线程缓存的时钟（最近一次 poll 返回的时间）计算到期时间和判断到期，
+     * 省去每次读时钟；代价是 runAfter 的起点是本轮 poll 返回的时刻。需在 loop 之前设置
+     */
+    void setUseCachedClock(bool on) { useCachedClock_ = on; }
+
+    // 切换 poll 模式，可跨线程调用
+    void setPollMode(bool on);
+    // 以下只能在loop线程调用
+    bool pollMode() const { return pollMode_; }
+    // 距离下一个需要处理的刻度的微秒数，没有定时器时返回 -1
+    int64_t nextTimeoutMicroSeconds(Timestamp now) const;
+    // 执行所有到期的定时器
+    void runExpired(Timestamp now);
+    /**
+     * 定时器使用的当前单调时间，poll 模式下 EventLoop 用它调用上面两个函数
+     * 总是精确的 CLOCK_MONOTONIC：LoopClock::setCoarse 打开时缓存的读数可能落后 timerfd 一个 jiffy，
+     * 到期时会判断成还没到，于是反复设置同一个已经过去的时刻而空转，这时不用缓存
+     */
+    Timestamp monotonicNow() const
+    {
+        return Timestamp(useCachedClock_ && !LoopClock::coarse() ? LoopClock::monotonic()
+                                                                 : LoopClock::preciseMonotonicMicroSeconds());
+    }
+
+private:
+    static const int kLevelBits = 6;
+    static const int kLevels = 6;                   // 64^6 ms 约 2.2 年，更远的放在最高层反复级联
+    static const int kSlots = 1 << kLevelBits;
+    static const uint64_t kSlotMask = kSlots - 1;
+    static const uint64_t kNotArmed = UINT64_MAX;
+
+    // 在本loop中添加 / 取消定时器
     void addTimerInLoop(Timer* timer);
+    void cancelInLoop(TimerId timerId);
+    void setPollModeInLoop(bool on);
 
     // 定时器读事件触发的函数
     void handleRead();
 
     // 重新设置timerfd_
     void resetTimerfd(int timerfd_, Timestamp expiration);
-    
-    // 移除所有已到期的定时器
-    // 1.获取到期的定时器
-    // 2.重置这些定时器（销毁或者重复定时任务）
-    std::vector<Entry> getExpired(Timestamp now);
-    void reset(const std::vector<Entry>& expired, Timestamp now);
+    // 按时间轮上下一个有事的刻度设置 timerfd，和已设置的相同时不调用系统调用
+    void rearm();
+    // 下一个需要处理的刻度：第 0 层是精确的到期刻度，高层是级联的刻度
+    uint64_t nextEventTick() const;
+
+    // 推进到 nowTick，把到期的定时器放入 expired_
+    void advance(uint64_t nowTick);
+    // 当前刻度第 0 层转完一圈时，把高层对应槽的定时器下放
+    void cascade();
+
+    // 挂到时间轮上 / 从时间轮上摘下
+    void link(Timer* timer);
+    void unlink(Timer* timer);
 
-    // 插入定时器的内部方法
-    bool insert(Timer* timer);
+    // 节点池
+    Timer* allocTimer();
+    void releaseTimer(Timer* timer);
+
+    static uint64_t toTick(Timestamp when);
+    TimerId addTimerMonotonic(TimerCallback cb, Timestamp when, double interval);
 
     EventLoop* loop_;           // 所属的EventLoop
-    const int timerfd_;         // timerfd是Linux提供的定时器接口
-    Channel timerfdChannel_;    // 封装timerfd_文件描述符
-    // Timer list sorted by expiration
-    TimerList timers_;          // 定时器队列（内部实现是红黑树）
+    int timerfd_;               // timerfd是Linux提供的定时器接口，poll 模式下为 -1
+    std::unique_ptr<Channel> timerfdChannel_;   // 封装timerfd_文件描述符
+    bool pollMode_;             // 是否由 EventLoop 的 poll 超时驱动
+    bool useCachedClock_;       // 是否使用 loop 线程缓存的时钟
+
+    Timer* wheel_[kLevels][kSlots];     // 各槽的链表头
+    uint64_t occupied_[kLevels];        // 各层非空槽的位图
+    uint64_t currentTick_;              // 已经处理到的刻度
+    uint64_t armedTick_;                // timerfd 当前设置的刻度
+    size_t count_;                      // 时间轮上的定时器个数
+
+    std::vector<Timer*> expired_;       // 本轮到期的定时器，复用避免分配
+    Timer* freeList_;                   // 空闲节点，用 next_ 串起来
 
     bool callingExpiredTimers_; // 标明正在获取超时定时器
 };
 
-#endif // TIMER_QUEUE_H
\ No newline at end of file
+#endif // TIMER_QUEUE_H